@@ -0,0 +1,82 @@
+#include "AllocationCounter.h"
+#include <stdlib.h>
+#include <new>
+#include <atomic>
+
+using namespace std;
+
+#ifdef WARLOCK_COUNT_ALLOCATIONS
+
+// Worker threads allocate through the same operator new.
+static atomic<unsigned int> gNumAllocations(0);
+
+void* operator new(size_t size)
+{
+	gNumAllocations++;
+
+	void* memory = malloc(size > 0 ? size : 1);
+	if(memory == nullptr)
+		throw bad_alloc();
+
+	return memory;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void* operator new(size_t size, const nothrow_t&)
+{
+	gNumAllocations++;
+	return malloc(size > 0 ? size : 1);
+}
+
+void* operator new[](size_t size, const nothrow_t&)
+{
+	return operator new(size, nothrow);
+}
+
+void operator delete(void* pMemory)
+{
+	free(pMemory);
+}
+
+void operator delete[](void* pMemory)
+{
+	free(pMemory);
+}
+
+void operator delete(void* pMemory, const nothrow_t&)
+{
+	free(pMemory);
+}
+
+void operator delete[](void* pMemory, const nothrow_t&)
+{
+	free(pMemory);
+}
+
+bool AllocationCounter::IsEnabled()
+{
+	return true;
+}
+
+unsigned int AllocationCounter::GetCount()
+{
+	return gNumAllocations;
+}
+
+#else
+
+bool AllocationCounter::IsEnabled()
+{
+	return false;
+}
+
+unsigned int AllocationCounter::GetCount()
+{
+	return 0;
+}
+
+#endif
\ No newline at end of file
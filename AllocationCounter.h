@@ -0,0 +1,10 @@
+#pragma once
+
+//! Counts the heap allocations made with operator new when WARLOCK_COUNT_ALLOCATIONS
+//! is defined, so the server can check that a steady-state tick doesn't allocate.
+//! RakNet allocates with malloc and isn't counted.
+namespace AllocationCounter
+{
+	bool			IsEnabled();
+	unsigned int	GetCount();
+}
\ No newline at end of file
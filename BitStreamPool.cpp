@@ -0,0 +1,65 @@
+#include "BitStreamPool.h"
+#include <algorithm>
+
+BitStreamPool::BitStreamPool(int size, int capacity)
+{
+	mCapacity = capacity;
+	mMaxInUse = 0;
+
+	mStreams.reserve(size);
+	mFree.reserve(size);
+	for(int i = 0; i < size; i++)
+		mFree.push_back(Create());
+}
+
+BitStreamPool::~BitStreamPool()
+{
+	for(int i = 0; i < mStreams.size(); i++)
+		delete mStreams[i];
+}
+
+RakNet::BitStream* BitStreamPool::Acquire()
+{
+	if(mFree.empty())
+		mFree.push_back(Create());
+
+	RakNet::BitStream* bitstream = mFree.back();
+	mFree.pop_back();
+
+	mMaxInUse = max(mMaxInUse, GetNumInUse());
+	return bitstream;
+}
+
+//! The stream keeps its memory for the next message.
+void BitStreamPool::Release(RakNet::BitStream* pBitstream)
+{
+	pBitstream->Reset();
+	mFree.push_back(pBitstream);
+}
+
+int BitStreamPool::GetSize()
+{
+	return mStreams.size();
+}
+
+int BitStreamPool::GetNumInUse()
+{
+	return mStreams.size() - mFree.size();
+}
+
+int BitStreamPool::GetMaxInUse()
+{
+	return mMaxInUse;
+}
+
+RakNet::BitStream* BitStreamPool::Create()
+{
+	RakNet::BitStream* bitstream = new RakNet::BitStream();
+
+	// Allocate the buffer up front, then make the stream empty again.
+	bitstream->AddBitsAndReallocate(BYTES_TO_BITS(mCapacity));
+	bitstream->Reset();
+
+	mStreams.push_back(bitstream);
+	return bitstream;
+}
\ No newline at end of file
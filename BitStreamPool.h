@@ -0,0 +1,29 @@
+#pragma once
+#include <vector>
+#include "BitStream.h"
+
+using namespace std;
+
+//! Preallocated outgoing bitstreams. Acquire() hands out an empty stream that
+//! already has room for a typical message, Release() gives it back. Grows
+//! when all streams are in use so callers never have to check.
+class BitStreamPool
+{
+public:
+	BitStreamPool(int size, int capacity);
+	~BitStreamPool();
+
+	RakNet::BitStream*	Acquire();
+	void				Release(RakNet::BitStream* pBitstream);
+
+	int GetSize();
+	int GetNumInUse();
+	int GetMaxInUse();
+private:
+	RakNet::BitStream* Create();
+
+	vector<RakNet::BitStream*>	mStreams;	// All streams, owned by the pool.
+	vector<RakNet::BitStream*>	mFree;
+	int							mCapacity;	// Bytes reserved in each stream.
+	int							mMaxInUse;
+};
\ No newline at end of file
@@ -0,0 +1,19 @@
+#pragma once
+
+//! Collision layers on the server, an object is in at most one layer.
+enum CollisionLayer
+{
+	COLLISION_LAYER_NONE = -1,
+	COLLISION_LAYER_PLAYER = 0,
+	COLLISION_LAYER_PROJECTILE,
+	NUM_COLLISION_LAYERS
+};
+
+#define COLLISION_BIT(layer) (1 << (layer))
+
+//! Which layers each layer collides with. Must be symmetric.
+static const int COLLISION_MASKS[NUM_COLLISION_LAYERS] =
+{
+	COLLISION_BIT(COLLISION_LAYER_PROJECTILE),											// Player
+	COLLISION_BIT(COLLISION_LAYER_PLAYER) | COLLISION_BIT(COLLISION_LAYER_PROJECTILE)	// Projectile
+};
\ No newline at end of file
@@ -28,6 +28,7 @@ BOOL WINAPI ConsoleHandlerRoutine(DWORD dwCtrlType)
 Console::Console()
 {
 	mThreadRunning = false; 
+	mVerbose = true;
 }
 
 Console::~Console()
@@ -106,7 +107,24 @@ void Console::InputReceived(string input)
 	printf(string("Recieved input! " + input).c_str());
 }
 
-void Console::AddLine(string text)
+void Console::AddLine(const string& text)
 {
-	printf(string(text + "\n").c_str());
+	AddLine(text.c_str());
+}
+
+//! Doesn't allocate, use with a char buffer for lines written every tick.
+void Console::AddLine(const char* text)
+{
+	printf("%s\n", text);
+}
+
+//! Lines logged for every input and collision are only written when verbose.
+void Console::SetVerbose(bool verbose)
+{
+	mVerbose = verbose;
+}
+
+bool Console::IsVerbose()
+{
+	return mVerbose;
 }
\ No newline at end of file
@@ -12,11 +12,15 @@ public:
 	void InputReceived(string input);
 
 	void GetInput();
-	void AddLine(string text);
+	void AddLine(const string& text);
+	void AddLine(const char* text);
+	void SetVerbose(bool verbose);
+	bool IsVerbose();
 	static void InputThreadEntryPoint(void* pThis);
 
 private:
 	bool mThreadRunning;
+	bool mVerbose;
 };
 
 extern Console* gConsole;
\ No newline at end of file
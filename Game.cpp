@@ -53,6 +53,7 @@ Game::Game(HINSTANCE hInstance, string caption, int width, int height)
 	SetConsoleTitle("Warlock Server");
 
 	SetFpsCap(100.0f);
+	mFrameRate = 100.0f;
 }
 
 Game::~Game()
@@ -76,7 +77,10 @@ void Game::Init()
 
 	// Create the peer.
 	mPeer = new Server();
-	mPeer->StartServer();
+	if(!mPeer->StartServer()) {
+		gConsole->AddLine("Failed to start the server!");
+		PostQuitMessage(1);
+	}
 	
 	// Set the fog color.
 	GetGraphics()->SetFogColor(XMFLOAT4(0.4f, 0.4f, 0.4f, 1.0f));
@@ -84,11 +88,30 @@ void Game::Init()
 
 void Game::Update(GLib::Input* pInput, float dt)
 {
+	// Sleep until a packet arrives when there is nothing to do.
+	if(mPeer->IsIdle())
+		mPeer->WaitForPackets();
+
 	mPeer->Update(pInput, dt);
-	GetGraphics()->Update(pInput, dt);
+
+	// A replayed match is an allocation check, the exit code is its result.
+	if(mPeer->IsReplayFinished())
+		PostQuitMessage(mPeer->ReportReplayAllocations());
+
+	if(!mPeer->IsIdle())
+		GetGraphics()->Update(pInput, dt);
+
+	// Only run the loop as fast as the server phase needs.
+	if(mFrameRate != mPeer->GetFrameRate()) {
+		mFrameRate = mPeer->GetFrameRate();
+		SetFpsCap(mFrameRate);
+	}
 
 	char buffer[256];
-	sprintf(buffer, "Warlock Server (FPS: %.1f)", GetCurrentFps());
+	if(mPeer->IsIdle())
+		sprintf(buffer, "Warlock Server (Idle, wake latency: %.2f ms avg, %.2f ms max)", mPeer->GetAverageWakeLatency(), mPeer->GetMaxWakeLatency());
+	else
+		sprintf(buffer, "Warlock Server (FPS: %.1f)", GetCurrentFps());
 	SetConsoleTitle(buffer);
 }
 
@@ -37,4 +37,5 @@ public:
 private:
 	Arena* mArena;
 	Server* mPeer;
+	float	mFrameRate;
 };
\ No newline at end of file
@@ -0,0 +1,163 @@
+#include "JobSystem.h"
+#include <algorithm>
+
+//! Uses one worker less than there are cores if numWorkers is 0, the calling thread is the last one.
+JobSystem::JobSystem(int numWorkers)
+{
+	if(numWorkers <= 0)
+		numWorkers = max((int)thread::hardware_concurrency() - 1, 0);
+
+	mNumWorkers = numWorkers;
+	mQuit = false;
+	mQueuedJobs = 0;
+
+	// The last queue belongs to the calling threads.
+	for(int i = 0; i < numWorkers + 1; i++) {
+		mQueues.push_back(new WorkQueue());
+		mQueues[i]->head = 0;
+	}
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		lock_guard<mutex> lock(mWakeLock);
+		mQuit = true;
+	}
+
+	mWakeCondition.notify_all();
+
+	for(int i = 0; i < mThreads.size(); i++)
+		mThreads[i].join();
+
+	for(int i = 0; i < mQueues.size(); i++)
+		delete mQueues[i];
+}
+
+//! The pool for the whole process, so several servers don't start a worker per core each.
+JobSystem* JobSystem::GetShared()
+{
+	static JobSystem shared;
+	return &shared;
+}
+
+//! Runs job(0) to job(count - 1) spread over all threads and returns when all are done.
+//! The order the jobs run in is undefined, so jobs should write to their own output.
+//! Can be called from several threads at once, each call only waits for its own jobs.
+void JobSystem::ParallelFor(int count, const JobFunction& job)
+{
+	if(count <= 0)
+		return;
+
+	if(count == 1 || mNumWorkers == 0) {
+		for(int i = 0; i < count; i++)
+			job(i);
+		return;
+	}
+
+	call_once(mStarted, &JobSystem::StartWorkers, this);
+
+	Batch batch;
+	batch.function = &job;
+	batch.pending = count;
+
+	// Deal the jobs out to all queues.
+	for(int i = 0; i < count; i++)
+	{
+		WorkQueue* queue = mQueues[i % mQueues.size()];
+		lock_guard<mutex> lock(queue->lock);
+
+		Job entry;
+		entry.batch = &batch;
+		entry.index = i;
+		queue->jobs.push_back(entry);
+	}
+
+	{
+		lock_guard<mutex> lock(mWakeLock);
+		mQueuedJobs += count;
+	}
+
+	mWakeCondition.notify_all();
+
+	// Help out while there are jobs to take, then sleep until the workers finished the rest.
+	int ownQueue = mQueues.size() - 1;
+	Job next;
+	while(batch.pending > 0 && FindJob(ownQueue, next))
+		RunJob(next);
+
+	unique_lock<mutex> lock(mDoneLock);
+	mDoneCondition.wait(lock, [&batch]() { return batch.pending == 0; });
+}
+
+int JobSystem::GetNumThreads()
+{
+	return mNumWorkers + 1;
+}
+
+void JobSystem::StartWorkers()
+{
+	for(int i = 0; i < mNumWorkers; i++)
+		mThreads.push_back(thread(&JobSystem::WorkerLoop, this, i));
+}
+
+//! Takes from the back of the own queue, otherwise steals from the front of another.
+bool JobSystem::FindJob(int queue, Job& job)
+{
+	for(int i = 0; i < mQueues.size(); i++)
+	{
+		WorkQueue* workQueue = mQueues[(queue + i) % mQueues.size()];
+		lock_guard<mutex> lock(workQueue->lock);
+
+		if(workQueue->head == workQueue->jobs.size())
+			continue;
+
+		if(i == 0) {
+			job = workQueue->jobs.back();
+			workQueue->jobs.pop_back();
+		}
+		else
+			job = workQueue->jobs[workQueue->head++];
+
+		// Keep the memory for the next time.
+		if(workQueue->head == workQueue->jobs.size()) {
+			workQueue->jobs.clear();
+			workQueue->head = 0;
+		}
+
+		mQueuedJobs--;
+		return true;
+	}
+
+	return false;
+}
+
+//! The last job of a batch wakes the thread waiting for it. The batch lives on
+//! that threads stack, so it isn't touched after the notify.
+void JobSystem::RunJob(Job& job)
+{
+	(*job.batch->function)(job.index);
+
+	if(--job.batch->pending == 0) {
+		lock_guard<mutex> lock(mDoneLock);
+		mDoneCondition.notify_all();
+	}
+}
+
+void JobSystem::WorkerLoop(int queue)
+{
+	while(true)
+	{
+		{
+			unique_lock<mutex> lock(mWakeLock);
+			mWakeCondition.wait(lock, [this]() { return mQuit || mQueuedJobs > 0; });
+
+			if(mQuit)
+				return;
+		}
+
+		Job job;
+		while(FindJob(queue, job))
+			RunJob(job);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,65 @@
+#pragma once
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+using namespace std;
+
+typedef function<void(int)> JobFunction;
+
+//! Work stealing job system. Every worker has its own queue, takes jobs from
+//! the back of it and steals from the front of the others when it runs dry.
+//! The thread calling ParallelFor() works on the jobs as well and sleeps
+//! once there is nothing left to take. The workers are only started by the
+//! first ParallelFor() that has more than one job, and all servers in the
+//! process share the pool from GetShared().
+class JobSystem
+{
+public:
+	JobSystem(int numWorkers = 0);
+	~JobSystem();
+
+	static JobSystem* GetShared();
+
+	void ParallelFor(int count, const JobFunction& job);
+	int	 GetNumThreads();
+private:
+	//! The jobs of one ParallelFor() call.
+	struct Batch
+	{
+		const JobFunction*	function;
+		atomic<int>			pending;
+	};
+
+	struct Job
+	{
+		Batch*	batch;
+		int		index;
+	};
+
+	struct WorkQueue
+	{
+		mutex		lock;
+		vector<Job>	jobs;
+		int			head;
+	};
+
+	void StartWorkers();
+	bool FindJob(int queue, Job& job);
+	void RunJob(Job& job);
+	void WorkerLoop(int queue);
+
+	vector<thread>		mThreads;
+	vector<WorkQueue*>	mQueues;
+	int					mNumWorkers;
+	once_flag			mStarted;
+	mutex				mWakeLock;
+	condition_variable	mWakeCondition;
+	mutex				mDoneLock;
+	condition_variable	mDoneCondition;
+	atomic<int>			mQueuedJobs;
+	bool				mQuit;
+};
\ No newline at end of file
@@ -0,0 +1,682 @@
+#ifdef __linux__
+#include "LinuxUdpTransport.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <netinet/udp.h>
+
+// Largest datagram, big enough for MAX_MESSAGE_BYTES and the header. The few
+// messages over the MTU, like the join bootstrap, are fragmented by IP.
+static const int	MAX_DATAGRAM = 2048 + 16;
+
+// channel (1), sequence (2), ack (2), ack bits (4).
+static const int	HEADER_SIZE = 9;
+static const int	MAX_PAYLOAD = MAX_DATAGRAM - HEADER_SIZE;
+
+// Datagrams read or written with one syscall.
+static const int	RECEIVE_BATCH = 64;
+static const int	SEND_BATCH = 64;
+
+// Most datagrams in one GSO send and the largest segment, GSO segments must fit the MTU.
+static const int	MAX_GSO_SEGMENTS = 64;
+static const int	MAX_GSO_SEGMENT_SIZE = 1472;
+
+// All segments of a GSO send together are one UDP datagram to the kernel.
+static const int	MAX_UDP_PAYLOAD = 65507;
+
+// Reliable datagrams in flight per peer, a power of two.
+static const int	RELIABLE_WINDOW = 256;
+
+static const int	MAX_PEERS = 16;
+static const unsigned int RESEND_TIME_MS = 100;
+static const unsigned int TIMEOUT_MS = 10000;
+static const unsigned int HEARTBEAT_MS = 1000;
+
+// A cookie is valid in the window it was made in and the one after.
+static const unsigned int COOKIE_WINDOW_MS = 10000;
+
+// The cookie after the header of CONNECT and CHALLENGE. CONNECT is as large as
+// CHALLENGE, so a spoofed request can't be used to send more to someone else.
+static const int	HANDSHAKE_SIZE = 9 + 4;
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+
+static void WriteHeader(unsigned char* pData, TransportChannel channel, unsigned short sequence, unsigned short ack, unsigned int ackBits)
+{
+	unsigned short netSequence = htons(sequence), netAck = htons(ack);
+	unsigned int netAckBits = htonl(ackBits);
+
+	pData[0] = (unsigned char)channel;
+	memcpy(pData + 1, &netSequence, 2);
+	memcpy(pData + 3, &netAck, 2);
+	memcpy(pData + 5, &netAckBits, 4);
+}
+
+LinuxUdpTransport::LinuxUdpTransport()
+{
+	mSocket = -1;
+	mEpoll = -1;
+	mUseGso = false;
+	mTime = 0;
+	mSecret = 0;
+	mNextDelivered = 0;
+}
+
+LinuxUdpTransport::~LinuxUdpTransport()
+{
+	Stop();
+}
+
+//! Opens a non-blocking socket on port and sets up all buffers, nothing is allocated per packet after this.
+bool LinuxUdpTransport::Start(unsigned short port, bool useGso)
+{
+	mSocket = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+	if(mSocket < 0)
+		return false;
+
+	sockaddr_in adress;
+	memset(&adress, 0, sizeof(adress));
+	adress.sin_family = AF_INET;
+	adress.sin_addr.s_addr = htonl(INADDR_ANY);
+	adress.sin_port = htons(port);
+
+	if(bind(mSocket, (sockaddr*)&adress, sizeof(adress)) < 0) {
+		Stop();
+		return false;
+	}
+
+	mEpoll = epoll_create1(0);
+	epoll_event event;
+	event.events = EPOLLIN;
+	event.data.fd = mSocket;
+	if(mEpoll < 0 || epoll_ctl(mEpoll, EPOLL_CTL_ADD, mSocket, &event) < 0) {
+		Stop();
+		return false;
+	}
+
+	// GSO needs Linux 4.18, without it every datagram is its own message.
+	mUseGso = useGso;
+	if(mUseGso) {
+		int probe = 0;
+		mUseGso = setsockopt(mSocket, SOL_UDP, UDP_SEGMENT, &probe, sizeof(probe)) == 0;
+	}
+
+	int random = open("/dev/urandom", O_RDONLY);
+	if(random < 0 || read(random, &mSecret, sizeof(mSecret)) != sizeof(mSecret))
+		mSecret = (unsigned int)getpid() * 2654435761u ^ (unsigned int)time(NULL);
+	if(random >= 0)
+		close(random);
+
+	// The receive ring.
+	mReceiveBuffer.resize(RECEIVE_BATCH * MAX_DATAGRAM);
+	mReceiveHeaders.resize(RECEIVE_BATCH);
+	mReceiveVectors.resize(RECEIVE_BATCH);
+	mReceiveAdresses.resize(RECEIVE_BATCH);
+
+	for(int i = 0; i < RECEIVE_BATCH; i++)
+	{
+		mReceiveVectors[i].iov_base = &mReceiveBuffer[i * MAX_DATAGRAM];
+		mReceiveVectors[i].iov_len = MAX_DATAGRAM;
+
+		memset(&mReceiveHeaders[i], 0, sizeof(mmsghdr));
+		mReceiveHeaders[i].msg_hdr.msg_iov = &mReceiveVectors[i];
+		mReceiveHeaders[i].msg_hdr.msg_iovlen = 1;
+		mReceiveHeaders[i].msg_hdr.msg_name = &mReceiveAdresses[i];
+		mReceiveHeaders[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+	}
+
+	// The send queue.
+	mSendBuffer.reserve(SEND_BATCH * MAX_DATAGRAM);
+	mOutgoing.reserve(SEND_BATCH);
+	mSendHeaders.resize(SEND_BATCH);
+	mSendVectors.resize(SEND_BATCH);
+	mSendControl.resize(SEND_BATCH * CMSG_SPACE(sizeof(unsigned short)));
+
+	mDeliverBuffer.reserve(RECEIVE_BATCH * MAX_DATAGRAM);
+	mDelivered.reserve(RECEIVE_BATCH);
+	mPeers.reserve(MAX_PEERS);
+	return true;
+}
+
+void LinuxUdpTransport::Stop()
+{
+	for(int i = 0; i < mPeers.size(); i++) {
+		delete[] mPeers[i].sendWindow;
+		delete[] mPeers[i].receiveWindow;
+	}
+
+	mPeers.clear();
+
+	if(mEpoll >= 0) {
+		close(mEpoll);
+		mEpoll = -1;
+	}
+
+	if(mSocket >= 0) {
+		close(mSocket);
+		mSocket = -1;
+	}
+}
+
+//! Sleeps until a datagram can be read or timeoutMs has passed, returns true if there is one.
+bool LinuxUdpTransport::Wait(int timeoutMs)
+{
+	epoll_event event;
+	return epoll_wait(mEpoll, &event, 1, timeoutMs) > 0;
+}
+
+//! Reads all waiting datagrams, resends what wasn't acked in time and drops
+//! the peers that went quiet. Call once per frame before Receive().
+void LinuxUdpTransport::Update(unsigned int timeMs)
+{
+	mTime = timeMs;
+	mDeliverBuffer.clear();
+	mDelivered.clear();
+	mNextDelivered = 0;
+
+	// Read batches until the socket is empty.
+	while(true)
+	{
+		for(int i = 0; i < RECEIVE_BATCH; i++)
+			mReceiveHeaders[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+
+		int received = recvmmsg(mSocket, &mReceiveHeaders[0], RECEIVE_BATCH, MSG_DONTWAIT, NULL);
+		if(received <= 0)
+			break;
+
+		for(int i = 0; i < received; i++)
+		{
+			const unsigned char* data = &mReceiveBuffer[i * MAX_DATAGRAM];
+			int length = mReceiveHeaders[i].msg_len;
+			if(length < HEADER_SIZE || data[0] > CHANNEL_ACCEPT)
+				continue;
+
+			// Unknown adresses can only start the handshake.
+			int peer = FindPeer(mReceiveAdresses[i]);
+			if(peer != -1)
+				HandleDatagram(peer, data, length);
+			else
+				HandleConnect(mReceiveAdresses[i], data, length);
+		}
+
+		if(received < RECEIVE_BATCH)
+			break;
+	}
+
+	for(int i = 0; i < mPeers.size(); i++)
+	{
+		Peer& peer = mPeers[i];
+		if(peer.state == PEER_FREE)
+			continue;
+
+		if(mTime - peer.lastReceiveTime > TIMEOUT_MS) {
+			Disconnect(i);
+			Deliver(TRANSPORT_DISCONNECTED, i, NULL, 0);
+			continue;
+		}
+
+		// Repeat CONNECT until the server answers.
+		if(peer.state == PEER_CONNECTING) {
+			if(mTime - peer.lastSendTime >= RESEND_TIME_MS) {
+				peer.lastSendTime = mTime;
+				SendHandshake(peer.adress, CHANNEL_CONNECT, peer.cookie);
+			}
+			continue;
+		}
+
+		// Resend the reliable datagrams that weren't acked.
+		for(unsigned short sequence = peer.oldestUnacked; sequence != peer.nextSendSequence; sequence++)
+		{
+			SendSlot& slot = peer.sendWindow[sequence & (RELIABLE_WINDOW - 1)];
+			if(slot.pending && mTime - slot.sendTime >= RESEND_TIME_MS) {
+				slot.sendTime = mTime;
+				QueueDatagram(i, CHANNEL_RELIABLE, sequence, slot.payload.data(), slot.payload.size());
+			}
+		}
+
+		// Keep quiet peers, like clients in the lobby, from timing out on the other side.
+		if(mTime - peer.lastSendTime >= HEARTBEAT_MS)
+			QueueDatagram(i, CHANNEL_ACK, 0, NULL, 0);
+	}
+}
+
+//! The next message or event received in the last Update().
+bool LinuxUdpTransport::Receive(TransportMessage& message)
+{
+	if(mNextDelivered == mDelivered.size())
+		return false;
+
+	const Delivery& delivery = mDelivered[mNextDelivered++];
+	message.event = delivery.event;
+	message.peer = delivery.peer;
+	message.data = delivery.length > 0 ? &mDeliverBuffer[delivery.offset] : NULL;
+	message.length = delivery.length;
+	return true;
+}
+
+//! Starts the handshake with a server at the time of the last Update(), returns
+//! the peer or -1 if all are in use. TRANSPORT_CONNECTED is received when the
+//! server accepted.
+int LinuxUdpTransport::Connect(const sockaddr_in& adress)
+{
+	int peer = FindPeer(adress);
+	if(peer != -1)
+		return peer;
+
+	peer = CreatePeer(adress, PEER_CONNECTING);
+	if(peer != -1)
+		SendHandshake(adress, CHANNEL_CONNECT, 0);
+
+	return peer;
+}
+
+//! Queues a message for the next Flush(). Returns false if it's too large
+//! or the peer has a full window of unacked reliable datagrams.
+bool LinuxUdpTransport::Send(int peer, const unsigned char* pData, int length, TransportChannel channel)
+{
+	if(!IsConnected(peer) || length > MAX_PAYLOAD || channel >= CHANNEL_ACK)
+		return false;
+
+	if(channel == CHANNEL_UNRELIABLE) {
+		QueueDatagram(peer, CHANNEL_UNRELIABLE, 0, pData, length);
+		return true;
+	}
+
+	Peer& target = mPeers[peer];
+	if(GetBacklog(peer) >= RELIABLE_WINDOW)
+		return false;
+
+	unsigned short sequence = target.nextSendSequence++;
+	SendSlot& slot = target.sendWindow[sequence & (RELIABLE_WINDOW - 1)];
+	slot.payload.assign(pData, pData + length);
+	slot.sendTime = mTime;
+	slot.pending = true;
+
+	QueueDatagram(peer, CHANNEL_RELIABLE, sequence, pData, length);
+	return true;
+}
+
+void LinuxUdpTransport::Broadcast(const unsigned char* pData, int length, TransportChannel channel, int exceptPeer)
+{
+	for(int i = 0; i < mPeers.size(); i++) {
+		if(i != exceptPeer && mPeers[i].state == PEER_CONNECTED)
+			Send(i, pData, length, channel);
+	}
+}
+
+//! Sends everything queued, together with the acks that are still owed.
+void LinuxUdpTransport::Flush()
+{
+	// Peers that got nothing else still need their acks.
+	for(int i = 0; i < mPeers.size(); i++) {
+		if(mPeers[i].state == PEER_CONNECTED && mPeers[i].ackPending)
+			QueueDatagram(i, CHANNEL_ACK, 0, NULL, 0);
+	}
+
+	SendQueued();
+}
+
+//! Forgets the peer without telling it, like RakPeerInterface::CloseConnection() without a notification.
+void LinuxUdpTransport::Disconnect(int peer)
+{
+	if(peer < 0 || peer >= mPeers.size() || mPeers[peer].state == PEER_FREE)
+		return;
+
+	// Drop what is queued for it, the datagrams point at its adress.
+	for(int i = 0; i < mOutgoing.size(); i++) {
+		if(mOutgoing[i].peer == peer)
+			mOutgoing[i].length = 0;
+	}
+
+	mPeers[peer].state = PEER_FREE;
+}
+
+bool LinuxUdpTransport::IsConnected(int peer)
+{
+	return peer >= 0 && peer < mPeers.size() && mPeers[peer].state == PEER_CONNECTED;
+}
+
+//! Reliable datagrams sent but not acked yet.
+int LinuxUdpTransport::GetBacklog(int peer)
+{
+	return (unsigned short)(mPeers[peer].nextSendSequence - mPeers[peer].oldestUnacked);
+}
+
+int LinuxUdpTransport::GetMaxPeers()
+{
+	return MAX_PEERS;
+}
+
+const sockaddr_in& LinuxUdpTransport::GetAdress(int peer)
+{
+	return mPeers[peer].adress;
+}
+
+int LinuxUdpTransport::FindPeer(const sockaddr_in& adress)
+{
+	for(int i = 0; i < mPeers.size(); i++) {
+		if(mPeers[i].state != PEER_FREE && mPeers[i].adress.sin_addr.s_addr == adress.sin_addr.s_addr && mPeers[i].adress.sin_port == adress.sin_port)
+			return i;
+	}
+
+	return -1;
+}
+
+//! Reuses the slot and windows of a disconnected peer if possible, returns -1 if all are in use.
+int LinuxUdpTransport::CreatePeer(const sockaddr_in& adress, PeerState state)
+{
+	int freeSlot = -1;
+	for(int i = 0; i < mPeers.size() && freeSlot == -1; i++) {
+		if(mPeers[i].state == PEER_FREE)
+			freeSlot = i;
+	}
+
+	if(freeSlot == -1)
+	{
+		if(mPeers.size() == MAX_PEERS)
+			return -1;
+
+		Peer newPeer;
+		newPeer.sendWindow = new SendSlot[RELIABLE_WINDOW];
+		newPeer.receiveWindow = new ReceiveSlot[RELIABLE_WINDOW];
+		for(int i = 0; i < RELIABLE_WINDOW; i++) {
+			newPeer.sendWindow[i].payload.reserve(MAX_PAYLOAD);
+			newPeer.receiveWindow[i].payload.reserve(MAX_PAYLOAD);
+		}
+
+		freeSlot = mPeers.size();
+		mPeers.push_back(newPeer);
+	}
+
+	Peer& peer = mPeers[freeSlot];
+	peer.adress = adress;
+	peer.state = state;
+	peer.lastReceiveTime = mTime;
+	peer.lastSendTime = mTime;
+	peer.cookie = 0;
+	peer.ackPending = false;
+	peer.nextSendSequence = 0;
+	peer.oldestUnacked = 0;
+	peer.nextDeliverSequence = 0;
+
+	for(int i = 0; i < RELIABLE_WINDOW; i++) {
+		peer.sendWindow[i].pending = false;
+		peer.receiveWindow[i].received = false;
+	}
+
+	return freeSlot;
+}
+
+//! A datagram from an unknown adress. A CONNECT without a valid cookie gets a
+//! CHALLENGE and nothing is stored, one with a valid cookie creates the peer.
+void LinuxUdpTransport::HandleConnect(const sockaddr_in& adress, const unsigned char* pData, int length)
+{
+	if(pData[0] != CHANNEL_CONNECT || length != HANDSHAKE_SIZE)
+		return;
+
+	unsigned int cookie;
+	memcpy(&cookie, pData + HEADER_SIZE, 4);
+	cookie = ntohl(cookie);
+
+	unsigned int window = mTime / COOKIE_WINDOW_MS;
+	if(cookie != MakeCookie(adress, window) && cookie != MakeCookie(adress, window - 1)) {
+		SendHandshake(adress, CHANNEL_CHALLENGE, MakeCookie(adress, window));
+		return;
+	}
+
+	int peer = CreatePeer(adress, PEER_CONNECTED);
+	if(peer == -1)
+		return;
+
+	SendHandshake(adress, CHANNEL_ACCEPT, 0);
+	Deliver(TRANSPORT_CONNECTED, peer, NULL, 0);
+}
+
+void LinuxUdpTransport::HandleDatagram(int peerIndex, const unsigned char* pData, int length)
+{
+	if(length < HEADER_SIZE)
+		return;
+
+	Peer& peer = mPeers[peerIndex];
+	peer.lastReceiveTime = mTime;
+	TransportChannel channel = (TransportChannel)pData[0];
+
+	if(channel == CHANNEL_CONNECT) {
+		// The client didn't get the ACCEPT.
+		if(peer.state == PEER_CONNECTED)
+			SendHandshake(peer.adress, CHANNEL_ACCEPT, 0);
+		return;
+	}
+
+	if(peer.state == PEER_CONNECTING)
+	{
+		if(channel == CHANNEL_CHALLENGE) {
+			if(length == HANDSHAKE_SIZE) {
+				memcpy(&peer.cookie, pData + HEADER_SIZE, 4);
+				peer.cookie = ntohl(peer.cookie);
+				peer.lastSendTime = mTime;
+				SendHandshake(peer.adress, CHANNEL_CONNECT, peer.cookie);
+			}
+			return;
+		}
+
+		// The server only sends anything else once it accepted, the ACCEPT itself may have been lost.
+		peer.state = PEER_CONNECTED;
+		Deliver(TRANSPORT_CONNECTED, peerIndex, NULL, 0);
+	}
+
+	if(channel == CHANNEL_CHALLENGE || channel == CHANNEL_ACCEPT)
+		return;
+
+	unsigned short sequence, ack;
+	unsigned int ackBits;
+	memcpy(&sequence, pData + 1, 2);
+	memcpy(&ack, pData + 3, 2);
+	memcpy(&ackBits, pData + 5, 4);
+	HandleAcks(peer, ntohs(ack), ntohl(ackBits));
+
+	const unsigned char* payload = pData + HEADER_SIZE;
+	int payloadLength = length - HEADER_SIZE;
+
+	if(channel == CHANNEL_UNRELIABLE) {
+		Deliver(TRANSPORT_MESSAGE, peerIndex, payload, payloadLength);
+		return;
+	}
+
+	if(channel != CHANNEL_RELIABLE)
+		return;
+
+	// Duplicates and datagrams too far ahead are only acked.
+	sequence = ntohs(sequence);
+	peer.ackPending = true;
+	short ahead = (short)(sequence - peer.nextDeliverSequence);
+	if(ahead < 0 || ahead >= RELIABLE_WINDOW)
+		return;
+
+	ReceiveSlot& slot = peer.receiveWindow[sequence & (RELIABLE_WINDOW - 1)];
+	if(!slot.received) {
+		slot.payload.assign(payload, payload + payloadLength);
+		slot.received = true;
+	}
+
+	// Deliver everything that is in order now.
+	while(true)
+	{
+		ReceiveSlot& next = peer.receiveWindow[peer.nextDeliverSequence & (RELIABLE_WINDOW - 1)];
+		if(!next.received)
+			break;
+
+		Deliver(TRANSPORT_MESSAGE, peerIndex, next.payload.data(), next.payload.size());
+		next.received = false;
+		peer.nextDeliverSequence++;
+	}
+}
+
+//! ack is the last sequence received in order, bit i of ackBits is set if ack + 2 + i was received as well.
+void LinuxUdpTransport::HandleAcks(Peer& peer, unsigned short ack, unsigned int ackBits)
+{
+	for(unsigned short sequence = peer.oldestUnacked; sequence != peer.nextSendSequence; sequence++)
+	{
+		short offset = (short)(sequence - ack);
+		bool acked = offset <= 0 || (offset >= 2 && offset < 34 && (ackBits & (1u << (offset - 2))) != 0);
+		if(acked)
+			peer.sendWindow[sequence & (RELIABLE_WINDOW - 1)].pending = false;
+	}
+
+	// Move the window past the acked datagrams.
+	while(peer.oldestUnacked != peer.nextSendSequence && !peer.sendWindow[peer.oldestUnacked & (RELIABLE_WINDOW - 1)].pending)
+		peer.oldestUnacked++;
+}
+
+//! Copies the datagram into the send buffer with the current acks for the peer,
+//! sends the buffer first when it's full.
+void LinuxUdpTransport::QueueDatagram(int peerIndex, TransportChannel channel, unsigned short sequence, const unsigned char* pPayload, int length)
+{
+	if(mOutgoing.size() == SEND_BATCH)
+		SendQueued();
+
+	Peer& peer = mPeers[peerIndex];
+
+	// The acks of the reliable datagrams received after the first missing one.
+	unsigned short ack = peer.nextDeliverSequence - 1;
+	unsigned int ackBits = 0;
+	for(int i = 0; i < 32; i++) {
+		if(peer.receiveWindow[(unsigned short)(ack + 2 + i) & (RELIABLE_WINDOW - 1)].received)
+			ackBits |= 1u << i;
+	}
+
+	Outgoing outgoing;
+	outgoing.peer = peerIndex;
+	outgoing.offset = mSendBuffer.size();
+	outgoing.length = HEADER_SIZE + length;
+
+	mSendBuffer.resize(mSendBuffer.size() + outgoing.length);
+	WriteHeader(&mSendBuffer[outgoing.offset], channel, sequence, ack, ackBits);
+	if(length > 0)
+		memcpy(&mSendBuffer[outgoing.offset + HEADER_SIZE], pPayload, length);
+
+	mOutgoing.push_back(outgoing);
+	peer.ackPending = false;
+	peer.lastSendTime = mTime;
+}
+
+//! Sends the queued datagrams with as few sendmmsg() calls as possible. Never
+//! queues anything itself, so QueueDatagram() can call it when the batch is full.
+void LinuxUdpTransport::SendQueued()
+{
+	int numHeaders = 0;
+	for(int i = 0; i < mOutgoing.size();)
+	{
+		const Outgoing& first = mOutgoing[i];
+
+		// Left behind by a peer that was disconnected.
+		if(first.length == 0) {
+			i++;
+			continue;
+		}
+
+		// Datagrams of the same size to the same peer are next to each other in the buffer, send them as GSO segments.
+		int count = 1;
+		if(mUseGso && first.length <= MAX_GSO_SEGMENT_SIZE) {
+			int maxSegments = min(MAX_GSO_SEGMENTS, MAX_UDP_PAYLOAD / first.length);
+			while(i + count < mOutgoing.size() && count < maxSegments && mOutgoing[i + count].peer == first.peer && mOutgoing[i + count].length == first.length)
+				count++;
+		}
+
+		iovec& datagrams = mSendVectors[numHeaders];
+		datagrams.iov_base = &mSendBuffer[first.offset];
+		datagrams.iov_len = first.length * count;
+
+		mmsghdr& header = mSendHeaders[numHeaders];
+		memset(&header, 0, sizeof(mmsghdr));
+		header.msg_hdr.msg_name = &mPeers[first.peer].adress;
+		header.msg_hdr.msg_namelen = sizeof(sockaddr_in);
+		header.msg_hdr.msg_iov = &datagrams;
+		header.msg_hdr.msg_iovlen = 1;
+
+		if(count > 1)
+		{
+			unsigned char* control = &mSendControl[numHeaders * CMSG_SPACE(sizeof(unsigned short))];
+			header.msg_hdr.msg_control = control;
+			header.msg_hdr.msg_controllen = CMSG_SPACE(sizeof(unsigned short));
+
+			cmsghdr* message = CMSG_FIRSTHDR(&header.msg_hdr);
+			message->cmsg_level = SOL_UDP;
+			message->cmsg_type = UDP_SEGMENT;
+			message->cmsg_len = CMSG_LEN(sizeof(unsigned short));
+			unsigned short segmentSize = first.length;
+			memcpy(CMSG_DATA(message), &segmentSize, sizeof(segmentSize));
+		}
+
+		numHeaders++;
+		i += count;
+	}
+
+	int sent = 0;
+	while(sent < numHeaders)
+	{
+		int result = sendmmsg(mSocket, &mSendHeaders[sent], numHeaders - sent, 0);
+		if(result > 0) {
+			sent += result;
+			continue;
+		}
+
+		// A full socket buffer drops the rest, the reliable datagrams are resent.
+		if(errno == EAGAIN || errno == EWOULDBLOCK)
+			break;
+
+		// Any other error only loses the header that failed.
+		sent++;
+	}
+
+	mSendBuffer.clear();
+	mOutgoing.clear();
+}
+
+//! Handshake datagrams go out right away, they are rare and may have no peer yet.
+void LinuxUdpTransport::SendHandshake(const sockaddr_in& adress, TransportChannel channel, unsigned int cookie)
+{
+	unsigned char data[HANDSHAKE_SIZE];
+	WriteHeader(data, channel, 0, 0, 0);
+
+	unsigned int netCookie = htonl(cookie);
+	memcpy(data + HEADER_SIZE, &netCookie, 4);
+	sendto(mSocket, data, HANDSHAKE_SIZE, 0, (const sockaddr*)&adress, sizeof(adress));
+}
+
+//! Only this server can make the cookie for an adress, it's never 0 so 0 can
+//! mean "no cookie yet" in the first CONNECT.
+unsigned int LinuxUdpTransport::MakeCookie(const sockaddr_in& adress, unsigned int window)
+{
+	unsigned int hash = mSecret ^ (window * 2654435761u);
+	hash ^= adress.sin_addr.s_addr;
+	hash *= 0x85ebca6b;
+	hash ^= hash >> 13;
+	hash ^= adress.sin_port;
+	hash *= 0xc2b2ae35;
+	hash ^= hash >> 16;
+	return hash | 1;
+}
+
+void LinuxUdpTransport::Deliver(TransportEvent event, int peer, const unsigned char* pData, int length)
+{
+	Delivery delivery;
+	delivery.event = event;
+	delivery.peer = peer;
+	delivery.offset = mDeliverBuffer.size();
+	delivery.length = length;
+
+	if(length > 0)
+		mDeliverBuffer.insert(mDeliverBuffer.end(), pData, pData + length);
+
+	mDelivered.push_back(delivery);
+}
+
+#endif
\ No newline at end of file
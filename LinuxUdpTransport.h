@@ -0,0 +1,172 @@
+#pragma once
+#ifdef __linux__
+#include <vector>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+using namespace std;
+
+//! What a datagram carries. Reliable is ordered and resent until acked, for
+//! the messages sent with Server::SendClientMessage() and the relays. Unreliable
+//! is sent once, for Server::SendImmediateMessage().
+enum TransportChannel
+{
+	CHANNEL_UNRELIABLE = 0,
+	CHANNEL_RELIABLE,
+	CHANNEL_ACK,				// Only the acks, no payload. Also the heartbeat.
+
+	// The handshake, see Connect().
+	CHANNEL_CONNECT,
+	CHANNEL_CHALLENGE,
+	CHANNEL_ACCEPT
+};
+
+enum TransportEvent
+{
+	TRANSPORT_MESSAGE = 0,
+	TRANSPORT_CONNECTED,		// Handshake done, like ID_NEW_INCOMING_CONNECTION.
+	TRANSPORT_DISCONNECTED		// Nothing heard for a while, like ID_CONNECTION_LOST.
+};
+
+//! A received message or event. The data stays valid until the next Update().
+struct TransportMessage
+{
+	TransportEvent			event;
+	int						peer;
+	const unsigned char*	data;
+	int						length;
+};
+
+//! UDP transport for Linux hosts that keeps the syscalls per packet down.
+//! Datagrams are read with recvmmsg() into a preallocated ring and sent with
+//! sendmmsg() in Flush(). Runs of equally sized datagrams to the same peer go
+//! out as one UDP GSO send when the kernel supports it. Wait() sleeps in
+//! epoll until the socket is readable.
+//!
+//! Every datagram has a small header with its channel, its sequence number
+//! and the acks for the reliable datagrams received from the peer, so acks
+//! ride along with the normal traffic. Peers that have nothing to send get
+//! an ack-only heartbeat now and then so they don't time out.
+//!
+//! Peers are known by their adress and have to do a handshake first: the
+//! client sends CONNECT, the server answers with a CHALLENGE cookie made from
+//! the adress and a secret, and only creates the peer once the cookie comes
+//! back in a second CONNECT. A spoofed source never sees the cookie, so it
+//! can't take up peer slots.
+class LinuxUdpTransport
+{
+public:
+	LinuxUdpTransport();
+	~LinuxUdpTransport();
+
+	bool Start(unsigned short port, bool useGso = true);
+	void Stop();
+
+	bool Wait(int timeoutMs);
+	void Update(unsigned int timeMs);
+	bool Receive(TransportMessage& message);
+
+	int	 Connect(const sockaddr_in& adress);
+
+	bool Send(int peer, const unsigned char* pData, int length, TransportChannel channel);
+	void Broadcast(const unsigned char* pData, int length, TransportChannel channel, int exceptPeer = -1);
+	void Flush();
+	void Disconnect(int peer);
+
+	bool IsConnected(int peer);
+	int	 GetBacklog(int peer);
+	int	 GetMaxPeers();
+	const sockaddr_in& GetAdress(int peer);
+private:
+	enum PeerState
+	{
+		PEER_FREE = 0,
+		PEER_CONNECTING,		// Connect() was called, waiting for CHALLENGE or ACCEPT.
+		PEER_CONNECTED
+	};
+
+	struct SendSlot
+	{
+		vector<unsigned char>	payload;
+		unsigned int			sendTime;
+		bool					pending;
+	};
+
+	struct ReceiveSlot
+	{
+		vector<unsigned char>	payload;
+		bool					received;
+	};
+
+	struct Peer
+	{
+		sockaddr_in		adress;
+		PeerState		state;
+		unsigned int	lastReceiveTime;
+		unsigned int	lastSendTime;
+		unsigned int	cookie;		// From the CHALLENGE, while connecting.
+		bool			ackPending;
+
+		// Reliable sending, the window is [oldestUnacked, nextSendSequence).
+		unsigned short	nextSendSequence;
+		unsigned short	oldestUnacked;
+		SendSlot*		sendWindow;
+
+		// Reliable receiving, delivered in order from nextDeliverSequence.
+		unsigned short	nextDeliverSequence;
+		ReceiveSlot*	receiveWindow;
+	};
+
+	struct Delivery
+	{
+		TransportEvent	event;
+		int				peer;
+		int				offset;		// In mDeliverBuffer.
+		int				length;
+	};
+
+	struct Outgoing
+	{
+		int		peer;
+		int		offset;		// In mSendBuffer.
+		int		length;
+	};
+
+	int	 FindPeer(const sockaddr_in& adress);
+	int	 CreatePeer(const sockaddr_in& adress, PeerState state);
+	void HandleConnect(const sockaddr_in& adress, const unsigned char* pData, int length);
+	void HandleDatagram(int peer, const unsigned char* pData, int length);
+	void HandleAcks(Peer& peer, unsigned short ack, unsigned int ackBits);
+	void QueueDatagram(int peer, TransportChannel channel, unsigned short sequence, const unsigned char* pPayload, int length);
+	void SendQueued();
+	void SendHandshake(const sockaddr_in& adress, TransportChannel channel, unsigned int cookie);
+	unsigned int MakeCookie(const sockaddr_in& adress, unsigned int window);
+	void Deliver(TransportEvent event, int peer, const unsigned char* pData, int length);
+
+	int						mSocket;
+	int						mEpoll;
+	bool					mUseGso;
+	unsigned int			mTime;
+	unsigned int			mSecret;	// For the cookies.
+	vector<Peer>			mPeers;
+
+	// Receive ring, set up once in Start().
+	vector<unsigned char>	mReceiveBuffer;
+	vector<mmsghdr>			mReceiveHeaders;
+	vector<iovec>			mReceiveVectors;
+	vector<sockaddr_in>		mReceiveAdresses;
+
+	// Datagrams queued for the next Flush().
+	vector<unsigned char>	mSendBuffer;
+	vector<Outgoing>		mOutgoing;
+	vector<mmsghdr>			mSendHeaders;
+	vector<iovec>			mSendVectors;
+	vector<unsigned char>	mSendControl;
+
+	// Messages and events for Receive(), copied since the windows get reused.
+	vector<unsigned char>	mDeliverBuffer;
+	vector<Delivery>		mDelivered;
+	int						mNextDelivered;
+};
+
+#endif
\ No newline at end of file
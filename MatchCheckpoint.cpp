@@ -0,0 +1,64 @@
+#include "MatchCheckpoint.h"
+#include <stdio.h>
+#include <windows.h>
+
+//! Writes to a temporary file first so a crash while saving keeps the old checkpoint.
+bool SaveCheckpoint(const MatchCheckpoint& checkpoint, const char* filename)
+{
+	RakNet::BitStream bitstream;
+	checkpoint.WriteFields(bitstream);
+
+	string tempName = string(filename) + ".tmp";
+	FILE* file = fopen(tempName.c_str(), "wb");
+	if(file == nullptr)
+		return false;
+
+	size_t written = fwrite(bitstream.GetData(), 1, bitstream.GetNumberOfBytesUsed(), file);
+	fclose(file);
+
+	if(written != bitstream.GetNumberOfBytesUsed())
+		return false;
+
+	return MoveFileEx(tempName.c_str(), filename, MOVEFILE_REPLACE_EXISTING) != 0;
+}
+
+bool LoadCheckpoint(MatchCheckpoint& checkpoint, const char* filename)
+{
+	FILE* file = fopen(filename, "rb");
+	if(file == nullptr)
+		return false;
+
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	if(size <= 0) {
+		fclose(file);
+		return false;
+	}
+
+	vector<unsigned char> data(size);
+	size_t read = fread(&data[0], 1, size, file);
+	fclose(file);
+
+	if(read != size)
+		return false;
+
+	RakNet::BitStream bitstream(&data[0], size, false);
+	return checkpoint.ReadFields(bitstream) && checkpoint.version == CHECKPOINT_VERSION;
+}
+
+void DeleteCheckpoint(const char* filename)
+{
+	remove(filename);
+}
+
+const CheckpointPlayer* FindCheckpointPlayer(const MatchCheckpoint& checkpoint, const string& name)
+{
+	for(int i = 0; i < checkpoint.players.count; i++) {
+		if(name == checkpoint.players.items[i].name.text)
+			return &checkpoint.players.items[i];
+	}
+
+	return nullptr;
+}
\ No newline at end of file
@@ -0,0 +1,48 @@
+#pragma once
+#include "MessageSchema.h"
+
+// Bump when the layout below changes, older checkpoints are ignored.
+static const int CHECKPOINT_VERSION = 2;
+
+// Most items a player can have in a checkpoint.
+static const int MAX_CHECKPOINT_ITEMS = 24;
+
+#define CHECKPOINT_ITEM_FIELDS(FIELD) \
+	FIELD(ItemName, item) \
+	FIELD(int, level)
+DECLARE_SCHEMA_STRUCT(CheckpointItem, CHECKPOINT_ITEM_FIELDS)
+
+typedef BoundedArray<CheckpointItem, MAX_CHECKPOINT_ITEMS>	CheckpointItemList;
+
+// Players are matched by name, their object ids change when they reconnect.
+#define CHECKPOINT_PLAYER_FIELDS(FIELD) \
+	FIELD(NameString, name) \
+	FIELD(int, gold) \
+	FIELD(int, score) \
+	FIELD(CheckpointItemList, items)
+DECLARE_SCHEMA_STRUCT(CheckpointPlayer, CHECKPOINT_PLAYER_FIELDS)
+
+typedef BoundedArray<CheckpointPlayer, MAX_MESSAGE_PLAYERS>	CheckpointPlayerList;
+
+// Unlike on the wire the value is a float, some cvars like -tick_budget are fractional.
+#define CHECKPOINT_CVAR_FIELDS(FIELD) \
+	FIELD(CvarString, cvar) \
+	FIELD(float, value)
+DECLARE_SCHEMA_STRUCT(CheckpointCvar, CHECKPOINT_CVAR_FIELDS)
+
+typedef BoundedArray<CheckpointCvar, MAX_CVARS>		CheckpointCvarList;
+
+//! The state of a match between rounds. Taken at every round boundary and
+//! written to disk so a crashed server can resume the match, and at the start
+//! of the match to restore for a rematch.
+#define MATCH_CHECKPOINT_FIELDS(FIELD) \
+	FIELD(int, version) \
+	FIELD(int, completedRounds) \
+	FIELD(CheckpointPlayerList, players) \
+	FIELD(CheckpointCvarList, cvars)
+DECLARE_SCHEMA_STRUCT(MatchCheckpoint, MATCH_CHECKPOINT_FIELDS)
+
+bool SaveCheckpoint(const MatchCheckpoint& checkpoint, const char* filename);
+bool LoadCheckpoint(MatchCheckpoint& checkpoint, const char* filename);
+void DeleteCheckpoint(const char* filename);
+const CheckpointPlayer* FindCheckpointPlayer(const MatchCheckpoint& checkpoint, const string& name);
\ No newline at end of file
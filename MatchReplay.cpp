@@ -0,0 +1,108 @@
+#include "MatchReplay.h"
+#include "RakPeerInterface.h"
+#include <string.h>
+
+// Ticks to keep running after the last packet, so its effects are simulated too.
+static const unsigned int REPLAY_TAIL_TICKS = 300;
+
+//! The header written before the data of every packet.
+struct PacketHeader
+{
+	unsigned int			tick;
+	RakNet::SystemAddress	adress;
+	RakNet::RakNetGUID		guid;
+	unsigned int			length;
+};
+
+MatchReplay::MatchReplay()
+{
+	mFile = nullptr;
+	mNextPacket = 0;
+	mPlaying = false;
+}
+
+MatchReplay::~MatchReplay()
+{
+	if(mFile != nullptr)
+		fclose(mFile);
+}
+
+bool MatchReplay::StartRecording(const char* filename)
+{
+	mFile = fopen(filename, "wb");
+	return mFile != nullptr;
+}
+
+//! Written right away so a crash keeps everything up to it.
+void MatchReplay::Record(unsigned int tick, RakNet::Packet* pPacket)
+{
+	PacketHeader header;
+	header.tick = tick;
+	header.adress = pPacket->systemAddress;
+	header.guid = pPacket->guid;
+	header.length = pPacket->length;
+
+	fwrite(&header, sizeof(header), 1, mFile);
+	fwrite(pPacket->data, 1, pPacket->length, mFile);
+	fflush(mFile);
+}
+
+bool MatchReplay::Load(const char* filename)
+{
+	FILE* file = fopen(filename, "rb");
+	if(file == nullptr)
+		return false;
+
+	PacketHeader header;
+	while(fread(&header, sizeof(header), 1, file) == 1)
+	{
+		RecordedPacket packet;
+		packet.tick = header.tick;
+		packet.adress = header.adress;
+		packet.guid = header.guid;
+		packet.offset = mData.size();
+		packet.length = header.length;
+
+		mData.resize(mData.size() + header.length);
+		if(header.length > 0 && fread(&mData[packet.offset], 1, header.length, file) != header.length)
+			break;
+
+		mPackets.push_back(packet);
+	}
+
+	fclose(file);
+	mNextPacket = 0;
+	mPlaying = !mPackets.empty();
+	return mPlaying;
+}
+
+//! Hands RakNet the packets recorded up to tick, ListenForPackets() receives them as usual.
+void MatchReplay::PushDuePackets(unsigned int tick, RakNet::RakPeerInterface* pPeer)
+{
+	while(mNextPacket < mPackets.size() && mPackets[mNextPacket].tick <= tick)
+	{
+		const RecordedPacket& recorded = mPackets[mNextPacket++];
+
+		RakNet::Packet* packet = pPeer->AllocatePacket(recorded.length);
+		memcpy(packet->data, &mData[recorded.offset], recorded.length);
+		packet->systemAddress = recorded.adress;
+		packet->guid = recorded.guid;
+		pPeer->PushBackPacket(packet, false);
+	}
+}
+
+bool MatchReplay::IsRecording()
+{
+	return mFile != nullptr;
+}
+
+bool MatchReplay::IsPlaying()
+{
+	return mPlaying;
+}
+
+//! All packets are played and the last one has had time to play out.
+bool MatchReplay::IsFinished(unsigned int tick)
+{
+	return mPlaying && mNextPacket == mPackets.size() && tick >= mPackets.back().tick + REPLAY_TAIL_TICKS;
+}
\ No newline at end of file
@@ -0,0 +1,47 @@
+#pragma once
+#include <stdio.h>
+#include <vector>
+#include "RakNetTypes.h"
+
+using namespace std;
+
+namespace RakNet {
+	class RakPeerInterface;
+}
+
+//! Records the packets the server receives together with the simulation tick
+//! they arrived in, and plays a recording back by pushing the packets into
+//! RakNet's receive queue at the same ticks. The server handles them as if
+//! the clients were connected. Replaying a recorded match in a build with
+//! WARLOCK_COUNT_ALLOCATIONS is the check that playing ticks don't allocate.
+class MatchReplay
+{
+public:
+	MatchReplay();
+	~MatchReplay();
+
+	bool StartRecording(const char* filename);
+	void Record(unsigned int tick, RakNet::Packet* pPacket);
+
+	bool Load(const char* filename);
+	void PushDuePackets(unsigned int tick, RakNet::RakPeerInterface* pPeer);
+
+	bool IsRecording();
+	bool IsPlaying();
+	bool IsFinished(unsigned int tick);
+private:
+	struct RecordedPacket
+	{
+		unsigned int			tick;
+		RakNet::SystemAddress	adress;
+		RakNet::RakNetGUID		guid;
+		int						offset;		// In mData.
+		int						length;
+	};
+
+	FILE*					mFile;
+	vector<RecordedPacket>	mPackets;
+	vector<unsigned char>	mData;
+	int						mNextPacket;
+	bool					mPlaying;
+};
\ No newline at end of file
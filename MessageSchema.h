@@ -0,0 +1,460 @@
+#pragma once
+#include <string.h>
+#include <string>
+#include "BitStream.h"
+#include "NetworkMessages.h"
+#include "ServerMessages.h"
+#include "NameTable.h"
+#include "States.h"
+#include "Items.h"
+#include "d3dUtil.h"
+
+using namespace std;
+
+//! The layout of the messages the server sends and receives. Every message is
+//! declared once as a list of fields, the struct, its Write() and Read() and
+//! the largest size it can have are generated from the list. Read() fails
+//! instead of overflowing when a message is too short or a string or list
+//! is longer than allowed.
+//!
+//!	#define EXAMPLE_FIELDS(FIELD) \
+//!		FIELD(int, playerId) \
+//!		FIELD(NameString, name)
+//!	DECLARE_MESSAGE(ExampleMessage, NMSG_EXAMPLE, EXAMPLE_FIELDS)
+
+// No message may be larger than this, checked at compile time.
+static const int MAX_MESSAGE_BYTES = 2048;
+
+// Most players a list in a message can hold.
+static const int MAX_MESSAGE_PLAYERS = 10;
+
+// Most cvars the join message can hold, the rest follow as cvar changes.
+static const int MAX_MESSAGE_CVARS = 20;
+
+// Most cvars the server can have, the game and tuning cvars are about 32.
+// Checked when the server starts, see Server::CheckCvars().
+static const int MAX_CVARS = 64;
+
+// Most casts in one batch message, more casts in a tick are split over more messages.
+static const int MAX_MESSAGE_CASTS = 16;
+
+// Most object ids in one removal message, more are split over more messages.
+static const int MAX_MESSAGE_REMOVALS = 64;
+
+// Most targets a player can add in one tick, the rest are dropped.
+static const int MAX_MOVEMENT_TARGETS = 8;
+
+// Item names are small enum values, larger ones are rejected when read.
+static const int MAX_ITEM_NAME = 256;
+
+//! How a field type is written. By default the value is written as it is.
+template<class T>
+struct FieldTraits
+{
+	enum { MAX_BITS = sizeof(T) * 8 };
+
+	static void Write(RakNet::BitStream& bitstream, const T& value)	{ bitstream.Write(value); }
+	static bool Read(RakNet::BitStream& bitstream, T& value)		{ return bitstream.Read(value); }
+};
+
+//! Bools take a single bit.
+template<>
+struct FieldTraits<bool>
+{
+	enum { MAX_BITS = 1 };
+
+	static void Write(RakNet::BitStream& bitstream, const bool& value)	{ bitstream.Write(value); }
+	static bool Read(RakNet::BitStream& bitstream, bool& value)			{ return bitstream.Read(value); }
+};
+
+//! Item names are written as they are but must be a known value when read.
+template<>
+struct FieldTraits<ItemName>
+{
+	enum { MAX_BITS = sizeof(ItemName) * 8 };
+
+	static void Write(RakNet::BitStream& bitstream, const ItemName& value)	{ bitstream.Write(value); }
+	static bool Read(RakNet::BitStream& bitstream, ItemName& value)
+	{
+		return bitstream.Read(value) && (int)value >= 0 && (int)value < MAX_ITEM_NAME;
+	}
+};
+
+//! A string of at most N - 1 characters.
+template<int N>
+struct BoundedString
+{
+	char text[N];
+
+	BoundedString()						{ text[0] = '\0'; }
+	void Set(const char* pText)			{ strncpy(text, pText, N - 1); text[N - 1] = '\0'; }
+	void Set(const string& str)			{ Set(str.c_str()); }
+};
+
+//! Same layout as BitStream::Write(const char*): the length as an unsigned short and the aligned characters.
+template<int N>
+struct FieldTraits<BoundedString<N>>
+{
+	enum { MAX_BITS = 16 + 7 + (N - 1) * 8 };
+
+	static void Write(RakNet::BitStream& bitstream, const BoundedString<N>& value)
+	{
+		unsigned short length = (unsigned short)strlen(value.text);
+		bitstream.Write(length);
+		bitstream.WriteAlignedBytes((const unsigned char*)value.text, length);
+	}
+
+	static bool Read(RakNet::BitStream& bitstream, BoundedString<N>& value)
+	{
+		unsigned short length;
+		if(!bitstream.Read(length) || length > N - 1)
+			return false;
+
+		if(length > 0 && !bitstream.ReadAlignedBytes((unsigned char*)value.text, length))
+			return false;
+
+		value.text[length] = '\0';
+		return true;
+	}
+};
+
+//! A list of at most N items.
+template<class T, int N>
+struct BoundedArray
+{
+	T	items[N];
+	int	count;
+
+	BoundedArray()						{ count = 0; }
+	bool Add(const T& item)				{ if(count == N) return false; items[count++] = item; return true; }
+};
+
+//! The count is written as an unsigned char.
+template<class T, int N>
+struct FieldTraits<BoundedArray<T, N>>
+{
+	enum { MAX_BITS = 8 + N * FieldTraits<T>::MAX_BITS };
+
+	static void Write(RakNet::BitStream& bitstream, const BoundedArray<T, N>& value)
+	{
+		bitstream.Write((unsigned char)value.count);
+		for(int i = 0; i < value.count; i++)
+			FieldTraits<T>::Write(bitstream, value.items[i]);
+	}
+
+	static bool Read(RakNet::BitStream& bitstream, BoundedArray<T, N>& value)
+	{
+		unsigned char count;
+		if(!bitstream.Read(count) || count > N)
+			return false;
+
+		value.count = count;
+		for(int i = 0; i < value.count; i++) {
+			if(!FieldTraits<T>::Read(bitstream, value.items[i]))
+				return false;
+		}
+
+		return true;
+	}
+};
+
+typedef BoundedString<32>	NameString;
+typedef BoundedString<32>	CvarString;
+typedef BoundedString<256>	ChatString;
+
+// A name as the client sends it, cut to a NameString by the server.
+typedef BoundedString<256>	JoinNameString;
+
+// Expanded for each field in a field list.
+#define SCHEMA_FIELD(type, name)			type name;
+#define SCHEMA_FIELD_BITS(type, name)		+ FieldTraits<type>::MAX_BITS
+#define SCHEMA_WRITE_FIELD(type, name)		FieldTraits<type>::Write(bitstream, name);
+#define SCHEMA_READ_FIELD(type, name)		&& FieldTraits<type>::Read(bitstream, name)
+
+//! A group of fields used inside messages, for example in a BoundedArray.
+#define DECLARE_SCHEMA_STRUCT(Name, FIELDS) \
+	struct Name \
+	{ \
+		FIELDS(SCHEMA_FIELD) \
+		enum { MAX_BITS = 0 FIELDS(SCHEMA_FIELD_BITS) }; \
+		void WriteFields(RakNet::BitStream& bitstream) const	{ FIELDS(SCHEMA_WRITE_FIELD) } \
+		bool ReadFields(RakNet::BitStream& bitstream)			{ return true FIELDS(SCHEMA_READ_FIELD); } \
+	}; \
+	template<> \
+	struct FieldTraits<Name> \
+	{ \
+		enum { MAX_BITS = Name::MAX_BITS }; \
+		static void Write(RakNet::BitStream& bitstream, const Name& value)	{ value.WriteFields(bitstream); } \
+		static bool Read(RakNet::BitStream& bitstream, Name& value)			{ return value.ReadFields(bitstream); } \
+	};
+
+//! A message starting with the id byte. Read() expects the id to be read already.
+//! Write() reserves the largest size up front so the stream doesn't grow field by field.
+#define DECLARE_MESSAGE(Name, Id, FIELDS) \
+	struct Name \
+	{ \
+		FIELDS(SCHEMA_FIELD) \
+		enum { MAX_BITS = 8 FIELDS(SCHEMA_FIELD_BITS), MAX_BYTES = (MAX_BITS + 7) / 8 }; \
+		static const unsigned char ID = Id; \
+		void Write(RakNet::BitStream& bitstream) const \
+		{ \
+			bitstream.AddBitsAndReallocate(MAX_BITS); \
+			bitstream.Write((unsigned char)ID); \
+			FIELDS(SCHEMA_WRITE_FIELD) \
+		} \
+		bool Read(RakNet::BitStream& bitstream)	{ return true FIELDS(SCHEMA_READ_FIELD); } \
+	}; \
+	static_assert(Name::MAX_BYTES <= MAX_MESSAGE_BYTES, #Name " can be larger than MAX_MESSAGE_BYTES");
+
+#define NO_FIELDS(FIELD)
+
+/************************************************************************/
+/* Client to server.                                                    */
+/************************************************************************/
+
+#define CONNECTION_DATA_FIELDS(FIELD) \
+	FIELD(JoinNameString, name)
+DECLARE_MESSAGE(ConnectionDataMessage, NMSG_CLIENT_CONNECTION_DATA, CONNECTION_DATA_FIELDS)
+
+// Inputs carry a sequence number, the world updates echo the last one processed
+// for each player so the client can reconcile its prediction.
+typedef unsigned short InputSequence;
+
+// Collected for each player and sent in the movement update of the tick.
+#define TARGET_ADDED_FIELDS(FIELD) \
+	FIELD(InputSequence, sequence) \
+	FIELD(unsigned char, objectId) \
+	FIELD(float, x) \
+	FIELD(float, y) \
+	FIELD(float, z) \
+	FIELD(bool, clear)
+DECLARE_MESSAGE(TargetAddedMessage, NMSG_TARGET_ADDED, TARGET_ADDED_FIELDS)
+
+#define SKILL_CAST_REQUEST_FIELDS(FIELD) \
+	FIELD(InputSequence, sequence) \
+	FIELD(unsigned char, skill) \
+	FIELD(int, owner) \
+	FIELD(ItemName, skillType) \
+	FIELD(int, skillLevel) \
+	FIELD(XMFLOAT3, start) \
+	FIELD(XMFLOAT3, end)
+DECLARE_MESSAGE(SkillCastRequest, NMSG_SKILL_CAST, SKILL_CAST_REQUEST_FIELDS)
+
+// Sent back to the other clients with the same layout.
+#define ITEM_FIELDS(FIELD) \
+	FIELD(int, playerId) \
+	FIELD(ItemName, item) \
+	FIELD(int, level)
+DECLARE_MESSAGE(ItemAddedMessage, NMSG_ITEM_ADDED, ITEM_FIELDS)
+DECLARE_MESSAGE(ItemRemovedMessage, NMSG_ITEM_REMOVED, ITEM_FIELDS)
+
+#define GOLD_CHANGE_FIELDS(FIELD) \
+	FIELD(int, playerId) \
+	FIELD(int, gold)
+DECLARE_MESSAGE(GoldChangeMessage, NMSG_GOLD_CHANGE, GOLD_CHANGE_FIELDS)
+
+// Relayed to all clients as it is.
+#define CHAT_MESSAGE_FIELDS(FIELD) \
+	FIELD(NameId, from) \
+	FIELD(ChatString, message)
+DECLARE_MESSAGE(ChatMessage, NMSG_CHAT_MESSAGE_SENT, CHAT_MESSAGE_FIELDS)
+
+// clientTime is in the clients own clock, it comes back in the response.
+#define TIME_SYNC_REQUEST_FIELDS(FIELD) \
+	FIELD(unsigned int, clientTime)
+DECLARE_MESSAGE(TimeSyncRequest, NMSG_TIME_SYNC_REQUEST, TIME_SYNC_REQUEST_FIELDS)
+
+/************************************************************************/
+/* Server to client.                                                    */
+/************************************************************************/
+
+// Times are in milliseconds. The client gets the round trip time from when it sent
+// the request and its offset to the server clock as serverTime + rtt / 2 - now.
+// averagePing is the servers own estimate of the round trip time.
+#define TIME_SYNC_RESPONSE_FIELDS(FIELD) \
+	FIELD(unsigned int, clientTime) \
+	FIELD(unsigned int, serverTime) \
+	FIELD(unsigned int, serverTick) \
+	FIELD(unsigned short, averagePing)
+DECLARE_MESSAGE(TimeSyncResponse, NMSG_TIME_SYNC_RESPONSE, TIME_SYNC_RESPONSE_FIELDS)
+
+// Sent before the world updates of a broadcast, they all belong to this tick.
+#define SNAPSHOT_BEGIN_FIELDS(FIELD) \
+	FIELD(unsigned int, serverTick) \
+	FIELD(unsigned int, serverTime)
+DECLARE_MESSAGE(SnapshotBeginMessage, NMSG_SNAPSHOT_BEGIN, SNAPSHOT_BEGIN_FIELDS)
+
+typedef BoundedArray<XMFLOAT3, MAX_MOVEMENT_TARGETS>	MovementTargetList;
+
+// clear is set if the player's target queue was cleared before the targets were added.
+#define PLAYER_MOVEMENT_FIELDS(FIELD) \
+	FIELD(unsigned char, objectId) \
+	FIELD(bool, clear) \
+	FIELD(MovementTargetList, targets)
+DECLARE_SCHEMA_STRUCT(PlayerMovement, PLAYER_MOVEMENT_FIELDS)
+
+typedef BoundedArray<PlayerMovement, MAX_MESSAGE_PLAYERS>	PlayerMovementList;
+
+// Replaces relaying every NMSG_TARGET_ADDED, only the players that moved are in it.
+#define MOVEMENT_UPDATE_FIELDS(FIELD) \
+	FIELD(PlayerMovementList, players)
+DECLARE_MESSAGE(MovementUpdateMessage, NMSG_MOVEMENT_UPDATE, MOVEMENT_UPDATE_FIELDS)
+
+typedef BoundedArray<int, MAX_MESSAGE_REMOVALS>	ObjectIdList;
+
+// Replaces one NMSG_OBJECT_REMOVED per object.
+#define OBJECTS_REMOVED_FIELDS(FIELD) \
+	FIELD(ObjectIdList, objectIds)
+DECLARE_MESSAGE(ObjectsRemovedMessage, NMSG_OBJECTS_REMOVED, OBJECTS_REMOVED_FIELDS)
+
+#define PLAYER_INFO_FIELDS(FIELD) \
+	FIELD(NameString, name) \
+	FIELD(int, objectId) \
+	FIELD(XMFLOAT3, position) \
+	FIELD(NameId, nameId)
+DECLARE_SCHEMA_STRUCT(PlayerInfo, PLAYER_INFO_FIELDS)
+
+typedef BoundedArray<PlayerInfo, MAX_MESSAGE_PLAYERS>	PlayerInfoList;
+typedef BoundedArray<NameId, MAX_MESSAGE_PLAYERS>		NameIdList;
+
+// Lets the client know it can send its connection data.
+DECLARE_MESSAGE(ConnectionSuccessMessage, NMSG_CONNECTION_SUCCESS, NO_FIELDS)
+
+#define CVAR_VALUE_FIELDS(FIELD) \
+	FIELD(CvarString, cvar) \
+	FIELD(int, value)
+DECLARE_SCHEMA_STRUCT(CvarValue, CVAR_VALUE_FIELDS)
+
+typedef BoundedArray<CvarValue, MAX_MESSAGE_CVARS>		CvarValueList;
+
+// The joining player, the state of the match, all players and all cvars.
+#define JOIN_BOOTSTRAP_FIELDS(FIELD) \
+	FIELD(int, objectId) \
+	FIELD(NameId, nameId) \
+	FIELD(CurrentState, state) \
+	FIELD(float, stateElapsed) \
+	FIELD(int, completedRounds) \
+	FIELD(float, arenaRadius) \
+	FIELD(PlayerInfoList, players) \
+	FIELD(CvarValueList, cvars)
+DECLARE_MESSAGE(JoinBootstrapMessage, NMSG_JOIN_BOOTSTRAP, JOIN_BOOTSTRAP_FIELDS)
+
+#define ADD_PLAYER_FIELDS(FIELD) \
+	FIELD(NameString, name) \
+	FIELD(int, objectId) \
+	FIELD(float, gold) \
+	FIELD(NameId, nameId)
+DECLARE_MESSAGE(AddPlayerMessage, NMSG_ADD_PLAYER, ADD_PLAYER_FIELDS)
+
+#define PLAYER_DISCONNECTED_FIELDS(FIELD) \
+	FIELD(NameId, nameId)
+DECLARE_MESSAGE(PlayerDisconnectedMessage, NMSG_PLAYER_DISCONNECTED, PLAYER_DISCONNECTED_FIELDS)
+
+#define CONNECTED_CLIENTS_FIELDS(FIELD) \
+	FIELD(NameIdList, players)
+DECLARE_MESSAGE(ConnectedClientsMessage, NSMG_CONNECTED_CLIENTS, CONNECTED_CLIENTS_FIELDS)
+
+#define CVAR_LIST_FIELDS(FIELD) \
+	FIELD(float, startGold) \
+	FIELD(float, shopTime) \
+	FIELD(float, roundTime) \
+	FIELD(float, numRounds) \
+	FIELD(float, goldPerKill) \
+	FIELD(float, goldPerWin) \
+	FIELD(float, goldPerRound) \
+	FIELD(float, lavaDamage) \
+	FIELD(float, projectileImpulse) \
+	FIELD(float, arenaRadius) \
+	FIELD(float, floodInterval) \
+	FIELD(float, floodSize) \
+	FIELD(float, cheats)
+DECLARE_MESSAGE(CvarListMessage, NMSG_REQUEST_CVAR_LIST, CVAR_LIST_FIELDS)
+
+// projectileId is -1 for skills without a projectile.
+#define SKILL_CAST_ENTRY_FIELDS(FIELD) \
+	FIELD(unsigned char, skill) \
+	FIELD(int, owner) \
+	FIELD(ItemName, skillType) \
+	FIELD(int, skillLevel) \
+	FIELD(XMFLOAT3, start) \
+	FIELD(XMFLOAT3, end) \
+	FIELD(int, projectileId)
+DECLARE_SCHEMA_STRUCT(SkillCastEntry, SKILL_CAST_ENTRY_FIELDS)
+
+typedef BoundedArray<SkillCastEntry, MAX_MESSAGE_CASTS>	SkillCastList;
+
+// The casts of a tick in the order they arrived, replaces one NMSG_SKILL_CAST per cast.
+#define SKILL_CAST_BATCH_FIELDS(FIELD) \
+	FIELD(SkillCastList, casts)
+DECLARE_MESSAGE(SkillCastBatchMessage, NMSG_SKILL_CAST_BATCH, SKILL_CAST_BATCH_FIELDS)
+
+#define CVAR_CHANGE_FIELDS(FIELD) \
+	FIELD(CvarString, cvar) \
+	FIELD(int, value) \
+	FIELD(int, show)
+DECLARE_MESSAGE(CvarChangeMessage, NMSG_CVAR_CHANGE, CVAR_CHANGE_FIELDS)
+
+#define ADD_CHAT_TEXT_FIELDS(FIELD) \
+	FIELD(ChatString, text) \
+	FIELD(COLORREF, color)
+DECLARE_MESSAGE(AddChatTextMessage, NMSG_ADD_CHAT_TEXT, ADD_CHAT_TEXT_FIELDS)
+
+DECLARE_MESSAGE(PerformRematchMessage, NMSG_PERFORM_REMATCH, NO_FIELDS)
+
+// The state changes of the match, they carry nothing else.
+DECLARE_MESSAGE(GameStartedMessage, NMSG_GAME_STARTED, NO_FIELDS)
+DECLARE_MESSAGE(RoundStartMessage, NMSG_ROUND_START, NO_FIELDS)
+DECLARE_MESSAGE(ChangeToPlayingMessage, NMSG_CHANGETO_PLAYING, NO_FIELDS)
+DECLARE_MESSAGE(FloodStartMessage, NMSG_FLOOD_START, NO_FIELDS)
+DECLARE_MESSAGE(ServerShutdownMessage, NMSG_SERVER_SHUTDOWN, NO_FIELDS)
+
+// The seconds left of the lobby countdown as text.
+#define COUNTDOWN_TICK_FIELDS(FIELD) \
+	FIELD(BoundedString<16>, text)
+DECLARE_MESSAGE(CountdownTickMessage, NMSG_COUNTDOWN_TICK, COUNTDOWN_TICK_FIELDS)
+
+#define STATE_TIMER_FIELDS(FIELD) \
+	FIELD(float, elapsed)
+DECLARE_MESSAGE(StateTimerMessage, NMSG_STATE_TIMER, STATE_TIMER_FIELDS)
+
+#define ARENA_RADIUS_FIELDS(FIELD) \
+	FIELD(float, radius)
+DECLARE_MESSAGE(ArenaRadiusMessage, NMSG_ARENA_RADIUS, ARENA_RADIUS_FIELDS)
+
+// winner is INVALID_NAME_ID if the last players died at the same time.
+#define ROUND_ENDED_FIELDS(FIELD) \
+	FIELD(NameId, winner)
+DECLARE_MESSAGE(RoundEndedMessage, NMSG_ROUND_ENDED, ROUND_ENDED_FIELDS)
+DECLARE_MESSAGE(GameOverMessage, NMSG_GAME_OVER, ROUND_ENDED_FIELDS)
+
+// eliminator is INVALID_NAME_ID if the player died on its own, like in the lava.
+#define PLAYER_ELIMINATED_FIELDS(FIELD) \
+	FIELD(NameId, killed) \
+	FIELD(NameId, eliminator)
+DECLARE_MESSAGE(PlayerEliminatedMessage, NMSG_PLAYER_ELIMINATED, PLAYER_ELIMINATED_FIELDS)
+
+#define PROJECTILE_PLAYER_COLLISION_FIELDS(FIELD) \
+	FIELD(int, projectileId) \
+	FIELD(int, playerId)
+DECLARE_MESSAGE(ProjectilePlayerCollisionMessage, NMSG_PROJECTILE_PLAYER_COLLISION, PROJECTILE_PLAYER_COLLISION_FIELDS)
+
+DECLARE_MESSAGE(ProjectileProjectileCollisionMessage, NMSG_PROJECTILE_PROJECTILE_COLLISION, NO_FIELDS)
+
+// Followed by a PlayerUpdate when the object is a player. type is a GLib::ObjectType.
+#define WORLD_UPDATE_FIELDS(FIELD) \
+	FIELD(int, type) \
+	FIELD(int, objectId) \
+	FIELD(XMFLOAT3, position) \
+	FIELD(XMFLOAT3, rotation)
+DECLARE_MESSAGE(WorldUpdateMessage, NMSG_WORLD_UPDATE, WORLD_UPDATE_FIELDS)
+
+// The types are the ones the Player getters return, checked in ServerArena.cpp.
+// lastInput is the last input of the player in the simulation.
+#define PLAYER_UPDATE_FIELDS(FIELD) \
+	FIELD(int, animation) \
+	FIELD(float, deathTimer) \
+	FIELD(float, health) \
+	FIELD(int, gold) \
+	FIELD(int, eliminated) \
+	FIELD(InputSequence, lastInput)
+DECLARE_SCHEMA_STRUCT(PlayerUpdate, PLAYER_UPDATE_FIELDS)
\ No newline at end of file
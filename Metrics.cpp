@@ -0,0 +1,247 @@
+#include "Metrics.h"
+#include <stdio.h>
+#include <windows.h>
+
+// Bucket bounds in ms, 16.7 is a tick at 60 Hz.
+static const double	HISTOGRAM_BOUNDS[] = {0.5, 1.0, 2.0, 4.0, 8.0, 16.7, 33.3, 50.0, 100.0, 250.0};
+static const int	NUM_HISTOGRAM_BOUNDS = sizeof(HISTOGRAM_BOUNDS) / sizeof(double);
+
+// Finer bounds for the stages, most take well under a millisecond.
+static const double	STAGE_BOUNDS[] = {0.05, 0.1, 0.25, 0.5, 1.0, 2.0, 4.0, 8.0, 16.7};
+static const int	NUM_STAGE_BOUNDS = sizeof(STAGE_BOUNDS) / sizeof(double);
+
+static const char*	PHASE_NAMES[NUM_SIMULATION_PHASES] = {"lobby", "shopping", "playing", "round_ended", "game_over"};
+static const char*	STAGE_NAMES[NUM_TICK_STAGES] = {"timers", "movement", "casts", "round", "arena", "removals", "broadcast", "listen"};
+
+Histogram::Histogram()
+{
+	bounds.assign(HISTOGRAM_BOUNDS, HISTOGRAM_BOUNDS + NUM_HISTOGRAM_BOUNDS);
+	counts.resize(NUM_HISTOGRAM_BOUNDS + 1, 0);
+	count = 0;
+	sum = 0.0;
+}
+
+void Histogram::SetBounds(const double* pBounds, int count)
+{
+	bounds.assign(pBounds, pBounds + count);
+	counts.assign(count + 1, 0);
+	this->count = 0;
+	sum = 0.0;
+}
+
+void Histogram::Observe(double value)
+{
+	int bucket = 0;
+	while(bucket < bounds.size() && value > bounds[bucket])
+		bucket++;
+
+	counts[bucket]++;
+	count++;
+	sum += value;
+}
+
+//! Writes the buckets cumulative, the way Prometheus wants them.
+static void WriteHistogram(string& text, const char* name, const char* labels, const Histogram& histogram)
+{
+	char buffer[256];
+	unsigned long long cumulative = 0;
+	const char* separator = labels[0] != '\0' ? "," : "";
+
+	for(int i = 0; i < histogram.counts.size(); i++)
+	{
+		cumulative += histogram.counts[i];
+		if(i < histogram.bounds.size())
+			sprintf(buffer, "%s_bucket{%s%sle=\"%g\"} %llu\n", name, labels, separator, histogram.bounds[i], cumulative);
+		else
+			sprintf(buffer, "%s_bucket{%s%sle=\"+Inf\"} %llu\n", name, labels, separator, cumulative);
+		text += buffer;
+	}
+
+	sprintf(buffer, "%s_sum{%s} %f\n%s_count{%s} %llu\n", name, labels, histogram.sum, name, labels, histogram.count);
+	text += buffer;
+}
+
+//! Writes a map of named values with one TYPE line for each name. The values of a name
+//! are grouped first, "name" and "name_other" would sort between "name" and "name{...}".
+static void WriteValues(string& text, const map<string, double>& values, const char* type)
+{
+	map<string, string> families;
+	char buffer[256];
+
+	for(auto iter = values.begin(); iter != values.end(); iter++)
+	{
+		string name = (*iter).first.substr(0, (*iter).first.find('{'));
+		sprintf(buffer, " %g\n", (*iter).second);
+		families[name] += (*iter).first + buffer;
+	}
+
+	for(auto iter = families.begin(); iter != families.end(); iter++)
+		text += "# TYPE " + (*iter).first + " " + type + "\n" + (*iter).second;
+}
+
+Metrics::Metrics()
+{
+	memset(mMessages, 0, sizeof(mMessages));
+
+	for(int i = 0; i < NUM_TICK_STAGES; i++)
+		mStageTimes[i].SetBounds(STAGE_BOUNDS, NUM_STAGE_BOUNDS);
+}
+
+Metrics::~Metrics()
+{
+
+}
+
+void Metrics::AddClient(RakNet::SystemAddress adress)
+{
+	ClientTraffic client;
+	client.adress = adress;
+	memset(&client.traffic, 0, sizeof(client.traffic));
+	mClients.push_back(client);
+}
+
+void Metrics::RemoveClient(RakNet::SystemAddress adress)
+{
+	for(int i = 0; i < mClients.size(); i++) {
+		if(mClients[i].adress == adress) {
+			mClients.erase(mClients.begin() + i);
+			break;
+		}
+	}
+}
+
+void Metrics::OnPacketReceived(unsigned char id, int bytes, RakNet::SystemAddress adress)
+{
+	mMessages[id].packetsIn++;
+	mMessages[id].bytesIn += bytes;
+
+	TrafficCounter* client = FindClient(adress);
+	if(client != nullptr) {
+		client->packetsIn++;
+		client->bytesIn += bytes;
+	}
+}
+
+//! A broadcast counts once for every client except adress, like RakNet sends it.
+void Metrics::OnPacketSent(unsigned char id, int bytes, bool broadcast, RakNet::SystemAddress adress)
+{
+	for(int i = 0; i < mClients.size(); i++)
+	{
+		if(broadcast == (mClients[i].adress == adress))
+			continue;
+
+		mClients[i].traffic.packetsOut++;
+		mClients[i].traffic.bytesOut += bytes;
+		mMessages[id].packetsOut++;
+		mMessages[id].bytesOut += bytes;
+	}
+}
+
+void Metrics::ObserveTick(SimulationPhase phase, double milliseconds)
+{
+	mTickTimes[phase].Observe(milliseconds);
+}
+
+void Metrics::ObserveStage(TickStage stage, double milliseconds)
+{
+	mStageTimes[stage].Observe(milliseconds);
+}
+
+void Metrics::ObserveDatabaseCall(double milliseconds)
+{
+	mDatabaseTimes.Observe(milliseconds);
+}
+
+void Metrics::AddCount(const string& name, double amount)
+{
+	mCounters[name] += amount;
+}
+
+void Metrics::SetGauge(const string& name, double value)
+{
+	mGauges[name] = value;
+}
+
+void Metrics::Write(string& text)
+{
+	char labels[64];
+	text.clear();
+
+	// Ticks.
+	text += "# TYPE warlock_tick_milliseconds histogram\n";
+	for(int i = 0; i < NUM_SIMULATION_PHASES; i++) {
+		sprintf(labels, "phase=\"%s\"", PHASE_NAMES[i]);
+		WriteHistogram(text, "warlock_tick_milliseconds", labels, mTickTimes[i]);
+	}
+
+	text += "# TYPE warlock_tick_stage_milliseconds histogram\n";
+	for(int i = 0; i < NUM_TICK_STAGES; i++) {
+		sprintf(labels, "stage=\"%s\"", STAGE_NAMES[i]);
+		WriteHistogram(text, "warlock_tick_stage_milliseconds", labels, mStageTimes[i]);
+	}
+
+	text += "# TYPE warlock_db_call_milliseconds histogram\n";
+	WriteHistogram(text, "warlock_db_call_milliseconds", "", mDatabaseTimes);
+
+	// Traffic, each family is written whole.
+	WriteTraffic(text, "warlock_packets_in_total", &TrafficCounter::packetsIn);
+	WriteTraffic(text, "warlock_bytes_in_total", &TrafficCounter::bytesIn);
+	WriteTraffic(text, "warlock_packets_out_total", &TrafficCounter::packetsOut);
+	WriteTraffic(text, "warlock_bytes_out_total", &TrafficCounter::bytesOut);
+
+	WriteValues(text, mCounters, "counter");
+	WriteValues(text, mGauges, "gauge");
+}
+
+//! Writes one traffic counter by message id, only the ids that were used, and by client.
+void Metrics::WriteTraffic(string& text, const char* name, unsigned long long TrafficCounter::* pValue)
+{
+	char buffer[256];
+	sprintf(buffer, "# TYPE %s counter\n", name);
+	text += buffer;
+
+	for(int i = 0; i < 256; i++)
+	{
+		const TrafficCounter& traffic = mMessages[i];
+		if(traffic.packetsIn == 0 && traffic.packetsOut == 0)
+			continue;
+
+		sprintf(buffer, "%s{nmsg=\"%i\"} %llu\n", name, i, traffic.*pValue);
+		text += buffer;
+	}
+
+	for(int i = 0; i < mClients.size(); i++) {
+		sprintf(buffer, "%s{client=\"%s\"} %llu\n", name, mClients[i].adress.ToString(), mClients[i].traffic.*pValue);
+		text += buffer;
+	}
+}
+
+//! Writes to a temporary file first so readers never see half a snapshot.
+bool Metrics::WriteToFile(const char* filename)
+{
+	string text;
+	Write(text);
+
+	string tempName = string(filename) + ".tmp";
+	FILE* file = fopen(tempName.c_str(), "w");
+	if(file == nullptr)
+		return false;
+
+	size_t written = fwrite(text.c_str(), 1, text.size(), file);
+	fclose(file);
+
+	if(written != text.size())
+		return false;
+
+	return MoveFileEx(tempName.c_str(), filename, MOVEFILE_REPLACE_EXISTING) != 0;
+}
+
+TrafficCounter* Metrics::FindClient(RakNet::SystemAddress adress)
+{
+	for(int i = 0; i < mClients.size(); i++) {
+		if(mClients[i].adress == adress)
+			return &mClients[i].traffic;
+	}
+
+	return nullptr;
+}
\ No newline at end of file
@@ -0,0 +1,87 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <map>
+#include "RakNetTypes.h"
+#include "TickPolicy.h"
+
+using namespace std;
+
+//! The parts of a frame that are timed on their own. The first ones are the
+//! steps of a simulation tick, broadcast and listen run once per frame.
+enum TickStage
+{
+	STAGE_TIMERS = 0,
+	STAGE_MOVEMENT,
+	STAGE_CASTS,
+	STAGE_ROUND,
+	STAGE_ARENA,		// World update, collisions and the round rules.
+	STAGE_REMOVALS,
+	STAGE_BROADCAST,
+	STAGE_LISTEN,
+	NUM_TICK_STAGES
+};
+
+//! Counts observations in fixed buckets, written as a Prometheus histogram.
+struct Histogram
+{
+	Histogram();
+	void SetBounds(const double* pBounds, int count);
+	void Observe(double value);
+
+	vector<double>				bounds;		// Upper bound of each bucket in ms, the last one is +Inf.
+	vector<unsigned long long>	counts;
+	unsigned long long			count;
+	double						sum;
+};
+
+//! Packets and bytes of one message id or one client.
+struct TrafficCounter
+{
+	unsigned long long	packetsIn;
+	unsigned long long	bytesIn;
+	unsigned long long	packetsOut;
+	unsigned long long	bytesOut;
+};
+
+//! Server telemetry. Counts the traffic per message id and per client, times
+//! the ticks of each phase and the stages inside them, and keeps named counters and gauges that the rest
+//! of the server sets. Write() outputs it all in the Prometheus text format.
+//! Counter and gauge names can contain labels, like name{label="value"}.
+class Metrics
+{
+public:
+	Metrics();
+	~Metrics();
+
+	void AddClient(RakNet::SystemAddress adress);
+	void RemoveClient(RakNet::SystemAddress adress);
+
+	void OnPacketReceived(unsigned char id, int bytes, RakNet::SystemAddress adress);
+	void OnPacketSent(unsigned char id, int bytes, bool broadcast, RakNet::SystemAddress adress);
+	void ObserveTick(SimulationPhase phase, double milliseconds);
+	void ObserveStage(TickStage stage, double milliseconds);
+	void ObserveDatabaseCall(double milliseconds);
+	void AddCount(const string& name, double amount = 1.0);
+	void SetGauge(const string& name, double value);
+
+	void Write(string& text);
+	bool WriteToFile(const char* filename);
+private:
+	struct ClientTraffic
+	{
+		RakNet::SystemAddress	adress;
+		TrafficCounter			traffic;
+	};
+
+	TrafficCounter* FindClient(RakNet::SystemAddress adress);
+	void			WriteTraffic(string& text, const char* name, unsigned long long TrafficCounter::* pValue);
+
+	TrafficCounter			mMessages[256];		// By message id.
+	vector<ClientTraffic>	mClients;
+	Histogram				mTickTimes[NUM_SIMULATION_PHASES];
+	Histogram				mStageTimes[NUM_TICK_STAGES];
+	Histogram				mDatabaseTimes;
+	map<string, double>		mCounters;
+	map<string, double>		mGauges;
+};
\ No newline at end of file
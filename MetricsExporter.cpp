@@ -0,0 +1,167 @@
+#include "MetricsExporter.h"
+#include "Metrics.h"
+#include "Console.h"
+#include <stdio.h>
+
+// Connections that haven't sent a full request by then are closed.
+static const DWORD	REQUEST_TIMEOUT_MS = 1000;
+
+// Connections that haven't taken the whole response by then are closed.
+static const DWORD	RESPONSE_TIMEOUT_MS = 5000;
+static const int	MAX_REQUEST_SIZE = 4096;
+static const int	MAX_CONNECTIONS = 8;
+
+MetricsExporter::MetricsExporter(Metrics* pMetrics)
+{
+	mMetrics = pMetrics;
+	mListenSocket = INVALID_SOCKET;
+	mStarted = false;
+}
+
+MetricsExporter::~MetricsExporter()
+{
+	Stop();
+}
+
+//! Only listens on 127.0.0.1, the metrics aren't meant for the internet.
+bool MetricsExporter::Start(int port)
+{
+	WSADATA data;
+	if(WSAStartup(MAKEWORD(2, 2), &data) != 0)
+		return false;
+
+	mStarted = true;
+	mListenSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if(mListenSocket == INVALID_SOCKET) {
+		Stop();
+		return false;
+	}
+
+	sockaddr_in adress;
+	memset(&adress, 0, sizeof(adress));
+	adress.sin_family = AF_INET;
+	adress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	adress.sin_port = htons(port);
+
+	u_long nonBlocking = 1;
+	if(bind(mListenSocket, (sockaddr*)&adress, sizeof(adress)) == SOCKET_ERROR || listen(mListenSocket, MAX_CONNECTIONS) == SOCKET_ERROR ||
+		ioctlsocket(mListenSocket, FIONBIO, &nonBlocking) == SOCKET_ERROR) {
+		Stop();
+		return false;
+	}
+
+	char buffer[128];
+	sprintf(buffer, "Serving metrics on 127.0.0.1:%i/metrics", port);
+	gConsole->AddLine(buffer);
+	return true;
+}
+
+void MetricsExporter::Stop()
+{
+	for(int i = 0; i < mConnections.size(); i++)
+		closesocket(mConnections[i].socket);
+	mConnections.clear();
+
+	if(mListenSocket != INVALID_SOCKET) {
+		closesocket(mListenSocket);
+		mListenSocket = INVALID_SOCKET;
+	}
+
+	if(mStarted) {
+		WSACleanup();
+		mStarted = false;
+	}
+}
+
+void MetricsExporter::Poll()
+{
+	if(mListenSocket == INVALID_SOCKET)
+		return;
+
+	// Accept the new connections.
+	SOCKET client;
+	while(mConnections.size() < MAX_CONNECTIONS && (client = accept(mListenSocket, NULL, NULL)) != INVALID_SOCKET)
+	{
+		u_long nonBlocking = 1;
+		ioctlsocket(client, FIONBIO, &nonBlocking);
+
+		Connection connection;
+		connection.socket = client;
+		connection.acceptTime = GetTickCount();
+		connection.responseTime = 0;
+		connection.sent = 0;
+		mConnections.push_back(connection);
+	}
+
+	// Read the requests, then send the responses as far as the send buffers allow.
+	for(int i = 0; i < mConnections.size(); i++)
+	{
+		Connection& connection = mConnections[i];
+		bool done = connection.response.empty() ? Receive(connection) : Send(connection);
+
+		if(done) {
+			closesocket(connection.socket);
+			mConnections.erase(mConnections.begin() + i);
+			i--;
+		}
+	}
+}
+
+//! True if the connection should be closed. Makes the response once the request is complete.
+bool MetricsExporter::Receive(Connection& connection)
+{
+	char buffer[1024];
+	int received = recv(connection.socket, buffer, sizeof(buffer), 0);
+
+	if(received > 0) {
+		connection.request.append(buffer, received);
+		if(connection.request.find("\r\n\r\n") != string::npos) {
+			Respond(connection);
+			return Send(connection);
+		}
+
+		return connection.request.size() > MAX_REQUEST_SIZE;
+	}
+	else if(received == 0 || WSAGetLastError() != WSAEWOULDBLOCK)
+		return true;
+
+	return GetTickCount() - connection.acceptTime > REQUEST_TIMEOUT_MS;
+}
+
+//! True if the connection should be closed. Sends what fits, the rest waits for the next poll.
+bool MetricsExporter::Send(Connection& connection)
+{
+	while(connection.sent < connection.response.size())
+	{
+		int sent = send(connection.socket, connection.response.c_str() + connection.sent, connection.response.size() - connection.sent, 0);
+		if(sent == SOCKET_ERROR) {
+			if(WSAGetLastError() != WSAEWOULDBLOCK)
+				return true;
+
+			return GetTickCount() - connection.responseTime > RESPONSE_TIMEOUT_MS;
+		}
+
+		connection.sent += sent;
+	}
+
+	shutdown(connection.socket, SD_SEND);
+	return true;
+}
+
+//! Any GET gets the metrics, they are the only thing served.
+void MetricsExporter::Respond(Connection& connection)
+{
+	if(connection.request.compare(0, 4, "GET ") == 0)
+	{
+		mMetrics->Write(mBody);
+
+		char header[256];
+		sprintf(header, "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %u\r\nConnection: close\r\n\r\n", (unsigned int)mBody.size());
+		connection.response = header + mBody;
+	}
+	else
+		connection.response = "HTTP/1.0 405 Method Not Allowed\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+
+	connection.responseTime = GetTickCount();
+	connection.sent = 0;
+}
\ No newline at end of file
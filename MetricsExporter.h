@@ -0,0 +1,42 @@
+#pragma once
+#include "WindowsIncludes.h"
+#include <vector>
+#include <string>
+
+using namespace std;
+
+class Metrics;
+
+//! Serves the metrics over HTTP on a localhost port so Prometheus can scrape
+//! them. Non-blocking, Poll() accepts and answers requests from the main loop.
+//! A response that doesn't fit the send buffer is sent over several polls.
+class MetricsExporter
+{
+public:
+	MetricsExporter(Metrics* pMetrics);
+	~MetricsExporter();
+
+	bool Start(int port);
+	void Stop();
+	void Poll();
+private:
+	struct Connection
+	{
+		SOCKET	socket;
+		DWORD	acceptTime;
+		DWORD	responseTime;
+		string	request;
+		string	response;
+		int		sent;		// Bytes of the response sent so far.
+	};
+
+	bool Receive(Connection& connection);
+	bool Send(Connection& connection);
+	void Respond(Connection& connection);
+
+	Metrics*			mMetrics;
+	SOCKET				mListenSocket;
+	vector<Connection>	mConnections;
+	string				mBody;
+	bool				mStarted;
+};
\ No newline at end of file
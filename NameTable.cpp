@@ -0,0 +1,62 @@
+#include "NameTable.h"
+
+NameTable::NameTable()
+{
+
+}
+
+NameTable::~NameTable()
+{
+
+}
+
+//! Returns INVALID_NAME_ID when the table is full.
+NameId NameTable::Add(const string& name, int objectId)
+{
+	// Reuse the first free id.
+	int index = 0;
+	while(index < mEntries.size() && mEntries[index].used)
+		index++;
+
+	if(index >= INVALID_NAME_ID)
+		return INVALID_NAME_ID;
+
+	if(index == mEntries.size())
+		mEntries.push_back(Entry());
+
+	mEntries[index].name = name;
+	mEntries[index].objectId = objectId;
+	mEntries[index].used = true;
+
+	return (NameId)index;
+}
+
+void NameTable::Remove(NameId id)
+{
+	if(!IsValid(id))
+		return;
+
+	mEntries[id].used = false;
+	mEntries[id].name.clear();
+}
+
+NameId NameTable::GetId(int objectId)
+{
+	for(int i = 0; i < mEntries.size(); i++) {
+		if(mEntries[i].used && mEntries[i].objectId == objectId)
+			return (NameId)i;
+	}
+
+	return INVALID_NAME_ID;
+}
+
+const string& NameTable::GetName(NameId id)
+{
+	static const string unknown = "#NOVALUE";
+	return IsValid(id) ? mEntries[id].name : unknown;
+}
+
+bool NameTable::IsValid(NameId id)
+{
+	return id < mEntries.size() && mEntries[id].used;
+}
\ No newline at end of file
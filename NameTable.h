@@ -0,0 +1,36 @@
+#pragma once
+#include <string>
+#include <vector>
+
+using namespace std;
+
+typedef unsigned char NameId;
+
+// Used for "no player", for example when a player was killed by the lava.
+static const NameId INVALID_NAME_ID = 0xff;
+
+//! The player names of the match. A name is sent once when the player joins,
+//! after that all messages refer to the player by its NameId. Ids of players
+//! that left are reused.
+class NameTable
+{
+public:
+	NameTable();
+	~NameTable();
+
+	NameId	Add(const string& name, int objectId);
+	void	Remove(NameId id);
+
+	NameId			GetId(int objectId);
+	const string&	GetName(NameId id);
+	bool			IsValid(NameId id);
+private:
+	struct Entry
+	{
+		string	name;
+		int		objectId;
+		bool	used;
+	};
+
+	vector<Entry>	mEntries;	// Indexed by NameId.
+};
\ No newline at end of file
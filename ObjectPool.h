@@ -0,0 +1,71 @@
+#pragma once
+#include <vector>
+#include <new>
+#include <utility>
+
+using namespace std;
+
+//! A T that is allocated from a free list instead of the heap. The World
+//! deletes its objects through their virtual destructor, which calls the
+//! operator delete of the most derived class, so an object spawned as a
+//! Pooled<T> goes back to the free list by itself when it's removed.
+//! Only used from the main thread.
+template<class T>
+class Pooled : public T
+{
+public:
+	template<class... Args>
+	Pooled(Args&&... args)
+		: T(forward<Args>(args)...)
+	{
+
+	}
+
+	//! Allocates count objects up front, call at startup.
+	static void Reserve(int count)
+	{
+		GetFree().reserve(GetFree().size() + count);
+		for(int i = 0; i < count; i++)
+			GetFree().push_back(::operator new(sizeof(Pooled<T>)));
+	}
+
+	//! The heap is only used when the pool runs out, the memory is kept after that.
+	static void* operator new(size_t size)
+	{
+		vector<void*>& free = GetFree();
+		if(size != sizeof(Pooled<T>) || free.empty())
+			return ::operator new(size);
+
+		void* memory = free.back();
+		free.pop_back();
+		return memory;
+	}
+
+	static void operator delete(void* pMemory, size_t size)
+	{
+		if(size != sizeof(Pooled<T>)) {
+			::operator delete(pMemory);
+			return;
+		}
+
+		GetFree().push_back(pMemory);
+	}
+private:
+	// Frees the pooled memory when the program exits.
+	struct FreeList
+	{
+		vector<void*> blocks;
+
+		~FreeList()
+		{
+			for(int i = 0; i < blocks.size(); i++)
+				::operator delete(blocks[i]);
+		}
+	};
+
+	static vector<void*>& GetFree()
+	{
+		static FreeList free;
+		return free.blocks;
+	}
+};
\ No newline at end of file
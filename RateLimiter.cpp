@@ -0,0 +1,100 @@
+#include "RateLimiter.h"
+#include "Server.h"
+#include "Metrics.h"
+#include "TuningCvars.h"
+#include "NetworkMessages.h"
+#include <algorithm>
+
+static const char*	CLASS_NAMES[NUM_MESSAGE_CLASSES] = {"target", "skill_cast", "chat"};
+
+// Messages per second and the most that can be sent at once.
+static const string* RATE_CVARS[NUM_MESSAGE_CLASSES] = {&TuningCvars::TARGET_RATE, &TuningCvars::SKILL_CAST_RATE, &TuningCvars::CHAT_RATE};
+static const string* BURST_CVARS[NUM_MESSAGE_CLASSES] = {&TuningCvars::TARGET_BURST, &TuningCvars::SKILL_CAST_BURST, &TuningCvars::CHAT_BURST};
+static const float	DEFAULT_RATES[NUM_MESSAGE_CLASSES] = {20.0f, 8.0f, 2.0f};
+static const float	DEFAULT_BURSTS[NUM_MESSAGE_CLASSES] = {40.0f, 8.0f, 5.0f};
+
+static MessageClass GetMessageClass(unsigned char id)
+{
+	switch(id)
+	{
+		case NMSG_TARGET_ADDED:
+			return MESSAGE_CLASS_TARGET;
+		case NMSG_SKILL_CAST:
+			return MESSAGE_CLASS_SKILL_CAST;
+		case NMSG_CHAT_MESSAGE_SENT:
+			return MESSAGE_CLASS_CHAT;
+		default:
+			return NUM_MESSAGE_CLASSES;
+	}
+}
+
+RateLimiter::RateLimiter(Server* pServer)
+{
+	mServer = pServer;
+
+	// Built once so counting a drop doesn't allocate.
+	for(int i = 0; i < NUM_MESSAGE_CLASSES; i++)
+		mDropCounters[i] = string("warlock_rate_limited_total{class=\"") + CLASS_NAMES[i] + "\"}";
+}
+
+RateLimiter::~RateLimiter()
+{
+
+}
+
+//! New clients start with full buckets.
+void RateLimiter::AddClient(RakNet::SystemAddress adress)
+{
+	ClientBuckets client;
+	client.adress = adress;
+
+	for(int i = 0; i < NUM_MESSAGE_CLASSES; i++) {
+		client.buckets[i].tokens = mServer->GetCvarValue(*BURST_CVARS[i], DEFAULT_BURSTS[i]);
+		client.buckets[i].lastTime = mServer->GetServerTime();
+	}
+
+	mClients.push_back(client);
+}
+
+void RateLimiter::RemoveClient(RakNet::SystemAddress adress)
+{
+	for(int i = 0; i < mClients.size(); i++) {
+		if(mClients[i].adress == adress) {
+			mClients.erase(mClients.begin() + i);
+			break;
+		}
+	}
+}
+
+//! Takes a token for the message, returns false and counts the drop if there was none.
+bool RateLimiter::Allow(RakNet::SystemAddress adress, unsigned char id)
+{
+	MessageClass messageClass = GetMessageClass(id);
+	if(messageClass == NUM_MESSAGE_CLASSES)
+		return true;
+
+	for(int i = 0; i < mClients.size(); i++)
+	{
+		if(mClients[i].adress != adress)
+			continue;
+
+		// Refill for the time since the last message.
+		Bucket& bucket = mClients[i].buckets[messageClass];
+		unsigned int now = mServer->GetServerTime();
+		float rate = mServer->GetCvarValue(*RATE_CVARS[messageClass], DEFAULT_RATES[messageClass]);
+		float burst = mServer->GetCvarValue(*BURST_CVARS[messageClass], DEFAULT_BURSTS[messageClass]);
+		bucket.tokens = min(bucket.tokens + (now - bucket.lastTime) * rate / 1000.0f, burst);
+		bucket.lastTime = now;
+
+		if(bucket.tokens < 1.0f) {
+			mServer->GetMetrics()->AddCount(mDropCounters[messageClass]);
+			return false;
+		}
+
+		bucket.tokens -= 1.0f;
+		return true;
+	}
+
+	// Only connected clients can send these.
+	return false;
+}
\ No newline at end of file
@@ -0,0 +1,48 @@
+#pragma once
+#include <vector>
+#include <string>
+#include "RakNetTypes.h"
+
+using namespace std;
+
+class Server;
+
+//! The client messages that are rate limited, each has its own bucket.
+enum MessageClass
+{
+	MESSAGE_CLASS_TARGET = 0,
+	MESSAGE_CLASS_SKILL_CAST,
+	MESSAGE_CLASS_CHAT,
+	NUM_MESSAGE_CLASSES
+};
+
+//! Token buckets for every client and message class. A bucket refills at the
+//! rate of its class up to the burst size and every message takes a token,
+//! messages that find the bucket empty are dropped before they are handled.
+//! The rates and bursts are cvars and can be changed while running.
+class RateLimiter
+{
+public:
+	RateLimiter(Server* pServer);
+	~RateLimiter();
+
+	void AddClient(RakNet::SystemAddress adress);
+	void RemoveClient(RakNet::SystemAddress adress);
+	bool Allow(RakNet::SystemAddress adress, unsigned char id);
+private:
+	struct Bucket
+	{
+		float			tokens;
+		unsigned int	lastTime;	// Server time of the last refill in ms.
+	};
+
+	struct ClientBuckets
+	{
+		RakNet::SystemAddress	adress;
+		Bucket					buckets[NUM_MESSAGE_CLASSES];
+	};
+
+	Server*					mServer;
+	vector<ClientBuckets>	mClients;
+	string					mDropCounters[NUM_MESSAGE_CLASSES];
+};
\ No newline at end of file
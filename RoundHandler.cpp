@@ -7,10 +7,20 @@
 #include "Player.h"
 #include "ServerArena.h"
 #include "Console.h"
+#include "BitStreamPool.h"
+#include "MessageSchema.h"
+#include <algorithm>
+
+// Seconds between a round ending and the next one starting.
+static const float ROUND_RESTART_DELAY = 5.0f;
+
+// Seconds the lobby counts down before starting the game.
+static const int LOBBY_COUNTDOWN = 5;
 
 RoundHandler::RoundHandler()
 {
-	mEndCounter = 0.0f;
+	mStateStartTime = 0.0f;
+	mLobbyCountdown = 0;
 	mCompletedRounds = 0;
 	mRoundEnded = false;
 	mLobbyCountdownActive = false;
@@ -21,7 +31,8 @@ RoundHandler::RoundHandler()
 
 RoundHandler::~RoundHandler()
 {
-
+	mServer->GetTimers()->Cancel(mStateTimer);
+	mServer->GetTimers()->Cancel(mCountdownTimer);
 }
 
 void RoundHandler::Update(GLib::Input* pInput, float dt)
@@ -35,45 +46,29 @@ void RoundHandler::Update(GLib::Input* pInput, float dt)
 		return;
 	}
 
-	mArenaState.elapsed += dt;
-
-	// Start new round after 5 seconds.
-	if(mRoundEnded && mArenaState.elapsed > 5.0f) {
-		//mCompletedRounds++;
-		StartRound();
-		mRoundEnded = false;
-	}
-
-	UpdateLobby(dt);
+	// The state changes are driven by timers, this is only what gets sent to the clients.
+	mArenaState.elapsed = mServer->GetTimers()->GetTime() - mStateStartTime;
 }
 
-void RoundHandler::UpdateLobby(float dt)
+//! Runs every second while the lobby counts down.
+void RoundHandler::LobbyCountdownTick()
 {
-	// Lobby countdown [HACK][TODO][NOTE].
-	static float lobbyCountDownDelta = 0;
-	if(mLobbyCountdownActive)
-	{
-		lobbyCountDownDelta += dt;
-		mLobbyCountdown -= dt;
+	mLobbyCountdown--;
 
-		if(mLobbyCountdown > 0 && lobbyCountDownDelta > 1) {
-			char buffer[64];
-			sprintf(buffer, "%i", (int)mLobbyCountdown);
-
-			// Send countdown message.
-			RakNet::BitStream bitstream;
-			bitstream.Write((unsigned char)NMSG_COUNTDOWN_TICK);
-			bitstream.Write(buffer);
-			mServer->SendClientMessage(bitstream);
-
-			lobbyCountDownDelta = 0.0f;
-		}
+	if(mLobbyCountdown > 0) {
+		CountdownTickMessage message;
+		sprintf(message.text.text, "%i", mLobbyCountdown);
 
+		// Send countdown message.
+		RakNet::BitStream bitstream;
+		message.Write(bitstream);
+		mServer->SendClientMessage(bitstream);
+	}
+	else {
 		// Start the round.
-		if(mLobbyCountdown <= 0) {
-			mLobbyCountdownActive = false;
-			mServer->StartGame();
-		}
+		mServer->GetTimers()->Cancel(mCountdownTimer);
+		mLobbyCountdownActive = false;
+		mServer->StartGame();
 	}
 }
 
@@ -100,10 +95,19 @@ void RoundHandler::StartRound()
 		mPlayerList->operator[](i)->ClearTargetQueue();
 	}
 
+	// Everyone is alive again.
+	mAlivePlayers = *mPlayerList;
+
 	InitShoppingState(mArenaState, true);
 
+	// Change to playing state when the shopping time expires.
+	TimerWheel* timers = mServer->GetTimers();
+	mStateStartTime = timers->GetTime();
+	timers->Cancel(mStateTimer);
+	mStateTimer = timers->Schedule(mServer->GetCvarValue(Cvars::SHOP_TIME), [this]() { ChangeToPlaying(); });
+
 	RakNet::BitStream bitstream;
-	bitstream.Write((unsigned char)NMSG_ROUND_START);
+	RoundStartMessage().Write(bitstream);
 	mServer->SendClientMessage(bitstream);
 	mRoundEnded = false;
 
@@ -111,52 +115,79 @@ void RoundHandler::StartRound()
 
 	gConsole->AddLine("Round starting!");
 }
-bool RoundHandler::HasRoundEnded(string& winner)
-{
-	int numAlive = 0;
-	for(int i = 0; i < mPlayerList->size(); i++)
-	{
-		if(!mPlayerList->operator[](i)->GetEliminated()) {
-			winner = mPlayerList->operator[](i)->GetName();
-			numAlive++;
-		}
-	}
 
+//! O(1), the alive players are kept up to date by OnPlayerEliminated() etc.
+//! pWinner is null if the last players died at the same time.
+bool RoundHandler::HasRoundEnded(Player*& pWinner)
+{
 	bool ended = false;
-	if((numAlive <= 1) && mPlayerList->size() > 1 && !mRoundEnded) {
+	if((mAlivePlayers.size() <= 1) && mPlayerList->size() > 1 && !mRoundEnded) {
 		ended = true;
 		mRoundEnded = true;
-		mArenaState.elapsed = 0.0f;
+
+		pWinner = mAlivePlayers.empty() ? nullptr : mAlivePlayers[0];
+
+		// Start new round after a while, unless the game is over.
+		TimerWheel* timers = mServer->GetTimers();
+		mStateStartTime = timers->GetTime();
+		timers->Cancel(mStateTimer);
+		mStateTimer = timers->Schedule(ROUND_RESTART_DELAY, [this]() {
+			if(!mServer->IsGameOver())
+				StartRound();
+		});
 	}
 
 
 	return ended;
 }
 
-void RoundHandler::BroadcastStateTimer()
+//! Called when the shopping time expired.
+void RoundHandler::ChangeToPlaying()
 {
-	// Change to playing state if shopping time expired.
-	if(mArenaState.state == SHOPPING_STATE && mArenaState.elapsed >= mServer->GetCvarValue(Cvars::SHOP_TIME))
-	{
-		InitPlayingState(mArenaState, true);
+	InitPlayingState(mArenaState, true);
+	mStateStartTime = mServer->GetTimers()->GetTime();
 
-		for(int i = 0; i < mPlayerList->size(); i++)
-			mPlayerList->operator[](i)->SetPosition(XMFLOAT3(rand() % 50, 0, rand() % 50));
-
-		// Broadcast world before sending NMSG_CHANGETO_PLAYING so player positions are updated (the camera uses the new positions).
-		mServer->GetArena()->BroadcastWorld();
+	for(int i = 0; i < mPlayerList->size(); i++)
+		mPlayerList->operator[](i)->SetPosition(XMFLOAT3(rand() % 50, 0, rand() % 50));
 
-		RakNet::BitStream bitstream;
-		bitstream.Write((unsigned char)NMSG_CHANGETO_PLAYING);
-		mServer->SendClientMessage(bitstream);
-	}
+	// Broadcast world before sending NMSG_CHANGETO_PLAYING so player positions are updated (the camera uses the new positions).
+	mServer->GetArena()->BroadcastWorld();
 
 	RakNet::BitStream bitstream;
-	bitstream.Write((unsigned char)NMSG_STATE_TIMER);
-	bitstream.Write(mArenaState.elapsed);
+	ChangeToPlayingMessage().Write(bitstream);
 	mServer->SendClientMessage(bitstream);
 }
 
+void RoundHandler::BroadcastStateTimer()
+{
+	StateTimerMessage message;
+	message.elapsed = mArenaState.elapsed;
+
+	RakNet::BitStream* bitstream = mServer->GetBitStreamPool()->Acquire();
+	message.Write(*bitstream);
+	mServer->SendClientMessage(*bitstream);
+	mServer->GetBitStreamPool()->Release(bitstream);
+}
+
+//! Players joining are alive until they get eliminated.
+void RoundHandler::OnPlayerAdded(Player* pPlayer)
+{
+	if(!pPlayer->GetEliminated())
+		mAlivePlayers.push_back(pPlayer);
+}
+
+void RoundHandler::OnPlayerRemoved(Player* pPlayer)
+{
+	auto iter = find(mAlivePlayers.begin(), mAlivePlayers.end(), pPlayer);
+	if(iter != mAlivePlayers.end())
+		mAlivePlayers.erase(iter);
+}
+
+void RoundHandler::OnPlayerEliminated(Player* pPlayer)
+{
+	OnPlayerRemoved(pPlayer);
+}
+
 void RoundHandler::SetPlayerList(vector<Player*>* pPlayerList)
 {
 	mPlayerList = pPlayerList;
@@ -176,7 +207,11 @@ void RoundHandler::StartLobbyCountdown()
 {
 	mLobbyCountdownActive = true;
 	mServer->AddClientChatText("Game starting in\n", GLib::ColorRGBA(0, 255, 0, 255));
-	mLobbyCountdown = 5.0f;
+	mLobbyCountdown = LOBBY_COUNTDOWN;
+
+	TimerWheel* timers = mServer->GetTimers();
+	timers->Cancel(mCountdownTimer);
+	mCountdownTimer = timers->ScheduleRepeating(1.0f, [this]() { LobbyCountdownTick(); });
 }
 
 int RoundHandler::GetCompletedRounds()
@@ -184,11 +219,27 @@ int RoundHandler::GetCompletedRounds()
 	return mCompletedRounds;
 }
 
+//! True while waiting for the next round to start.
+bool RoundHandler::IsRoundEnded()
+{
+	return mRoundEnded;
+}
+
+bool RoundHandler::IsLobbyCountdownActive()
+{
+	return mLobbyCountdownActive;
+}
+
 void RoundHandler::AddRoundCompleted()
 {
 	mCompletedRounds++;
 }
 
+void RoundHandler::SetCompletedRounds(int completedRounds)
+{
+	mCompletedRounds = completedRounds;
+}
+
 void RoundHandler::Rematch()
 {
 	mCompletedRounds = 0;
@@ -1,5 +1,6 @@
 #pragma once
 #include "States.h"
+#include "TimerWheel.h"
 #include <string>
 #include <vector>
 
@@ -20,27 +21,38 @@ public:
 	~RoundHandler();
 
 	void Update(GLib::Input* pInput, float dt);
-	void UpdateLobby(float dt);
 	void Draw(GLib::Graphics* pGraphics);
 
 	void StartLobbyCountdown();
+	void LobbyCountdownTick();
 	void StartRound();
-	bool HasRoundEnded(string& winner);
+	void ChangeToPlaying();
+	bool HasRoundEnded(Player*& pWinner);
 	void BroadcastStateTimer();
 
+	void OnPlayerAdded(Player* pPlayer);
+	void OnPlayerRemoved(Player* pPlayer);
+	void OnPlayerEliminated(Player* pPlayer);
+
 	void SetPlayerList(vector<Player*>* pPlayerList);
 	void SetServer(Server* pServer);
 	ArenaState GetArenaState();
 	int GetCompletedRounds();
+	bool IsRoundEnded();
+	bool IsLobbyCountdownActive();
 	void AddRoundCompleted();
+	void SetCompletedRounds(int completedRounds);
 	void Rematch();
 private:
 	vector<Player*>* mPlayerList;
+	vector<Player*>	 mAlivePlayers;
 	ArenaState		 mArenaState;
 	Server*			 mServer;
 	bool			 mRoundEnded;
-	float			 mEndCounter;
-	float			 mLobbyCountdown;
+	float			 mStateStartTime;
+	TimerHandle		 mStateTimer;
+	TimerHandle		 mCountdownTimer;
+	int				 mLobbyCountdown;
 	bool			 mLobbyCountdownActive;
 	int				 mCompletedRounds;
 	bool			 mGameOver;
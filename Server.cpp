@@ -1,4 +1,5 @@
 #include <time.h>
+#include <math.h>
 #include "ServerMessageHandler.h"
 #include "CollisionHandler.h"
 #include "Server.h"
@@ -20,6 +21,75 @@
 #include "Config.h"
 #include "ServerCvars.h"
 #include "Console.h"
+#include "RakNetSocket2.h"
+#include "TimerWheel.h"
+#include "JobSystem.h"
+#include "AllocationCounter.h"
+#include "BitStreamPool.h"
+#include "MessageSchema.h"
+#include "GetTime.h"
+#include "SnapshotScheduler.h"
+#include "Metrics.h"
+#include "MetricsExporter.h"
+#include "TuningCvars.h"
+#include "TickWatchdog.h"
+#include "RateLimiter.h"
+#include "MatchReplay.h"
+
+// Resolution of the server clock in seconds.
+static const float	TIMER_RESOLUTION = 0.01f;
+
+// Idle mode settings.
+static const DWORD	IDLE_MAX_WAIT_MS = 500;		// Longest sleep without packets.
+static const DWORD	IDLE_AWAKE_MS = 500;		// Stay awake this long after a packet.
+static const float	IDLE_FRAME_RATE = 1000.0f;	// Frame cap while idle, the wait does the sleeping.
+
+// Outgoing bitstreams created up front and the bytes reserved in each.
+static const int	BITSTREAM_POOL_SIZE = 32;
+static const int	BITSTREAM_CAPACITY = MAX_MESSAGE_BYTES;
+
+// Written at the end of every round, removed when the game is over.
+static const char*	CHECKPOINT_FILE = "data/checkpoint.bin";
+
+// Metrics snapshots are written here, the gauges are refreshed this often.
+static const char*	METRICS_FILE = "data/metrics.prom";
+static const float	METRICS_GAUGE_INTERVAL = 1.0f;
+
+// Deferred relays are sent at least this often, in seconds.
+static const float	DEFERRED_RELAY_INTERVAL = 1.0f;
+
+// Playing ticks before allocations are checked, the containers grow to their size during them.
+static const int	ALLOCATION_WARMUP_TICKS = 120;
+
+// Recorded with -record_replay, played back with -play_replay.
+static const char*	REPLAY_FILE = "data/replay.bin";
+
+static double GetMilliseconds()
+{
+	LARGE_INTEGER now, frequency;
+	QueryPerformanceCounter(&now);
+	QueryPerformanceFrequency(&frequency);
+	return now.QuadPart * 1000.0 / frequency.QuadPart;
+}
+
+//! Records the stage that started at startTime and returns when it ended, the start of the next.
+static double ObserveStage(Metrics* pMetrics, TickStage stage, double startTime)
+{
+	double now = GetMilliseconds();
+	pMetrics->ObserveStage(stage, now - startTime);
+	return now;
+}
+
+// Header bits of a connected RakNet datagram. Offline datagrams (pings, connection
+// requests) don't have the valid bit set, acks and naks carry no messages.
+static const unsigned char	DATAGRAM_VALID = 0x80;
+static const unsigned char	DATAGRAM_ACK = 0x40;
+static const unsigned char	DATAGRAM_NAK = 0x20;
+
+// Set from RakNet's receive thread when a datagram arrives.
+static HANDLE			gDatagramEvent = NULL;
+static volatile LONG	gDatagramPending = 0;
+static LARGE_INTEGER	gDatagramTime;
 
 Server::Server()
 {
@@ -28,6 +98,30 @@ Server::Server()
 	// Create the RakNet peer
 	mRaknetPeer = RakNet::RakPeerInterface::GetInstance();
 
+	// The server clock, everything that runs on timers uses it.
+	mTimers = new TimerWheel(TIMER_RESOLUTION);
+
+	// Worker threads for the parallel parts of the simulation, shared with the other servers in the process.
+	mJobs = JobSystem::GetShared();
+
+	mBitStreamPool = new BitStreamPool(BITSTREAM_POOL_SIZE, BITSTREAM_CAPACITY);
+
+	// Adapts the snapshot rate of each client to its link.
+	mSnapshots = new SnapshotScheduler(this);
+
+	mMetrics = new Metrics();
+	mMetricsExporter = new MetricsExporter(mMetrics);
+
+	// Sheds load when the ticks don't fit in their budget.
+	mWatchdog = new TickWatchdog(mMetrics);
+	mDeferredRelayTime = 0.0f;
+
+	// Drops input spam before it's handled and relayed.
+	mRateLimiter = new RateLimiter(this);
+
+	mNames = new NameTable();
+	mHostNameId = INVALID_NAME_ID;
+
 	mSkillInterpreter = new ServerSkillInterpreter();
 	mItemLoader = new ItemLoaderXML("data/items.xml");	// [NOTE]!
 	mMessageHandler = new ServerMessageHandler(this);
@@ -51,7 +145,51 @@ Server::Server()
 
 	mCvars.LoadFromFile("data/cvars.cfg");
 
+	// Filled when the game starts, zeroed until then.
+	mMatchStartCheckpoint = MatchCheckpoint();
+
+	// Resume the match that was running when the server went down, if its players come back.
+	mResumingMatch = LoadCheckpoint(mRecoveryCheckpoint, CHECKPOINT_FILE);
+	if(mResumingMatch)
+		gConsole->AddLine("Found a checkpoint, the match resumes if its players start a game.");
+
+	// Record the received packets, or play a recording back instead of listening to real clients.
+	mReplay = new MatchReplay();
+	if(GetCvarValue(TuningCvars::PLAY_REPLAY, 0.0f) != 0.0f) {
+		if(mReplay->Load(REPLAY_FILE))
+			gConsole->AddLine("Playing back the match in data/replay.bin.");
+		else
+			gConsole->AddLine("Failed to load data/replay.bin!");
+	}
+	else if(GetCvarValue(TuningCvars::RECORD_REPLAY, 0.0f) != 0.0f && !mReplay->StartRecording(REPLAY_FILE))
+		gConsole->AddLine("Failed to record to data/replay.bin!");
+
+	// Metrics over HTTP and to a file.
+	int metricsPort = GetCvarValue(TuningCvars::METRICS_PORT, 9108);
+	if(metricsPort > 0 && !mMetricsExporter->Start(metricsPort))
+		gConsole->AddLine("Failed to start the metrics exporter.");
+
+	mTimers->ScheduleRepeating(METRICS_GAUGE_INTERVAL, [this]() { UpdateMetricGauges(); });
+
+	float metricsInterval = GetCvarValue(TuningCvars::METRICS_FILE_INTERVAL, 10.0f);
+	if(metricsInterval > 0.0f)
+		mTimers->ScheduleRepeating(metricsInterval, [this]() { mMetrics->WriteToFile(METRICS_FILE); });
+
 	mInLobby = true;
+	mPhase = PHASE_LOBBY;
+	mSimulationTick = 0;
+	mSimulationDelta = 0.0f;
+	mBroadcastDelta = 0.0f;
+
+	mDatagramEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	gDatagramEvent = mDatagramEvent;
+	mLastActivityTime = 0;
+	mWakePending = false;
+	mNumWakes = 0;
+	mTotalWakeLatency = 0.0;
+	mMaxWakeLatency = 0.0;
+	mNumPlayingTicks = 0;
+	mNumAllocatingTicks = 0;
 	
 	gConsole->AddLine("Server successfully started!");
 	gConsole->AddLine(mServerName.c_str());
@@ -61,30 +199,196 @@ Server::~Server()
 {
 	// Send NMSG_SERVER_SHUTDOWN to all connected players.
 	RakNet::BitStream bitstream;
-	bitstream.Write((unsigned char)NMSG_SERVER_SHUTDOWN);
+	ServerShutdownMessage().Write(bitstream);
 	SendClientMessage(bitstream);
 
+	for(int i = 0; i < mDeferredRelays.size(); i++)
+		mRaknetPeer->DeallocatePacket(mDeferredRelays[i]);
+
 	delete mSkillInterpreter;
 	delete mMessageHandler;
 	delete mItemLoader;
 	delete mRoundHandler;
 	delete mArena;
+	delete mTimers;
+	delete mBitStreamPool;
+	delete mSnapshots;
+	delete mWatchdog;
+	delete mRateLimiter;
+	delete mReplay;
+	delete mMetricsExporter;
+	delete mMetrics;
+	delete mNames;
 
 	mDatabase->RemoveServer(mHostName);
 	delete mDatabase;
 
 	mRaknetPeer->Shutdown(300);
 	RakNet::RakPeerInterface::DestroyInstance(mRaknetPeer);
+
+	gDatagramEvent = NULL;
+	CloseHandle(mDatagramEvent);
 }
 
+//! Steps the simulation and broadcasts at the rates of the current phase.
 void Server::Update(GLib::Input* pInput, float dt)
 {
+	double frameStart = GetMilliseconds();
+
+	SimulationPhase phase = GetSimulationPhase();
+	if(phase != mPhase) {
+		// Carry over at most one step so the new rate starts right away.
+		float step = 1.0f / TICK_POLICY[phase].simulationHz;
+		mSimulationDelta = min(mSimulationDelta, step);
+		mPhase = phase;
+		mNumPlayingTicks = 0;
+		mWatchdog->Reset();
+	}
+
+	const TickRates& rates = TICK_POLICY[mPhase];
+
+	// Fixed simulation steps.
+	float step = 1.0f / rates.simulationHz;
+	mSimulationDelta += dt;
+	for(int i = 0; i < MAX_SIMULATION_STEPS && mSimulationDelta >= step; i++) {
+		unsigned int allocations = AllocationCounter::GetCount();
+		double startTime = GetMilliseconds();
+		Simulate(pInput, step);
+		mMetrics->ObserveTick(mPhase, GetMilliseconds() - startTime);
+		CheckTickAllocations(allocations);
+		mSimulationDelta -= step;
+	}
+
+	// Drop the steps we couldn't catch up with.
+	bool droppedSteps = mSimulationDelta >= step;
+	if(droppedSteps)
+		mSimulationDelta = 0.0f;
+
+	// Broadcast the world.
+	if(rates.broadcastHz > 0.0f)
+	{
+		mBroadcastDelta += dt;
+		if(mBroadcastDelta >= 1.0f / rates.broadcastHz) {
+			unsigned int allocations = AllocationCounter::GetCount();
+			double startTime = GetMilliseconds();
+			float snapshotRate = mWatchdog->IsDegraded(DEGRADE_SNAPSHOT_RATE) ? rates.broadcastHz * 0.5f : rates.broadcastHz;
+			mSnapshots->Update(mBroadcastDelta, snapshotRate);
+			mArena->BroadcastTick();
+			mMetrics->ObserveStage(STAGE_BROADCAST, GetMilliseconds() - startTime);
+			CheckTickAllocations(allocations);
+			mBroadcastDelta = 0.0f;
+		}
+	}
+
+	// Listen for incoming packets.
+	mDeferredRelayTime += dt;
+	double listenStart = GetMilliseconds();
+	ListenForPackets();
+	mMetrics->ObserveStage(STAGE_LISTEN, GetMilliseconds() - listenStart);
+
+	// Players that left, before the next tick can reuse their ids.
+	mArena->FlushRemovedObjects();
+
+	mMetricsExporter->Poll();
+
+	// Let the watchdog compare the frame to its budget.
+	mWatchdog->SetMaxLevel(GetCvarValue(TuningCvars::WATCHDOG_MAX_LEVEL, NUM_DEGRADATIONS));
+	mWatchdog->OnFrame(dt, GetMilliseconds() - frameStart, dt * 1000.0 * GetCvarValue(TuningCvars::TICK_BUDGET, 0.8f), droppedSteps);
+	gConsole->SetVerbose(!mWatchdog->IsDegraded(DEGRADE_VERBOSE_LOGGING));
+}
+
+//! Each step is timed as its own stage.
+void Server::Simulate(GLib::Input* pInput, float dt)
+{
+	mSimulationTick++;
+
+	// Fire the timers that expired before this tick.
+	double time = GetMilliseconds();
+	mTimers->Advance(dt);
+	time = ObserveStage(mMetrics, STAGE_TIMERS, time);
+
+	// Apply the targets and spawn the casts the players sent since the last tick.
+	mArena->ApplyMovement();
+	time = ObserveStage(mMetrics, STAGE_MOVEMENT, time);
+	mSkillInterpreter->SpawnQueued(this);
+	time = ObserveStage(mMetrics, STAGE_CASTS, time);
+
 	// Update the world handler.
 	mRoundHandler->Update(pInput, dt);
+	time = ObserveStage(mMetrics, STAGE_ROUND, time);
 	mArena->Update(pInput, dt);
+	time = ObserveStage(mMetrics, STAGE_ARENA, time);
 
-	// Listen for incoming packets.
-	ListenForPackets();
+	// The projectiles that expired or hit something this tick.
+	mArena->FlushRemovedObjects();
+	ObserveStage(mMetrics, STAGE_REMOVALS, time);
+}
+
+//! A playing tick shouldn't allocate once the round is under way.
+//! Logs the ticks that did, only does something with WARLOCK_COUNT_ALLOCATIONS.
+void Server::CheckTickAllocations(unsigned int countBefore)
+{
+	if(!AllocationCounter::IsEnabled() || mPhase != PHASE_PLAYING)
+		return;
+
+	if(++mNumPlayingTicks <= ALLOCATION_WARMUP_TICKS)
+		return;
+
+	unsigned int allocations = AllocationCounter::GetCount() - countBefore;
+	if(allocations > 0) {
+		mNumAllocatingTicks++;
+
+		char buffer[128];
+		sprintf(buffer, "[ALLOC] Tick %i made %u allocations (%i allocating ticks)", mNumPlayingTicks, allocations, mNumAllocatingTicks);
+		gConsole->AddLine(buffer);
+	}
+}
+
+//! True once a replayed match has played out.
+bool Server::IsReplayFinished()
+{
+	return mReplay->IsFinished(mSimulationTick);
+}
+
+//! The result of the allocation check of a replayed match, as an exit code.
+//! Fails when any playing tick allocated or nothing could be counted.
+int Server::ReportReplayAllocations()
+{
+	if(!AllocationCounter::IsEnabled()) {
+		gConsole->AddLine("[ALLOC] Replay not checked, build with WARLOCK_COUNT_ALLOCATIONS.");
+		return 2;
+	}
+
+	char buffer[128];
+	sprintf(buffer, "[ALLOC] Replay %s, %i playing ticks allocated.", mNumAllocatingTicks == 0 ? "passed" : "failed", mNumAllocatingTicks);
+	gConsole->AddLine(buffer);
+	return mNumAllocatingTicks == 0 ? 0 : 1;
+}
+
+//! The gauges are read from the rest of the server every METRICS_GAUGE_INTERVAL.
+void Server::UpdateMetricGauges()
+{
+	static const string PLAYERS = "warlock_players";
+	static const string CONNECTIONS = "warlock_connections";
+	static const string PROJECTILES = "warlock_projectiles";
+	static const string POOL_SIZE = "warlock_bitstream_pool_size";
+	static const string POOL_IN_USE = "warlock_bitstream_pool_in_use";
+	static const string POOL_MAX_IN_USE = "warlock_bitstream_pool_max_in_use";
+
+	mMetrics->SetGauge(PLAYERS, mArena->GetPlayerListPointer()->size());
+	mMetrics->SetGauge(CONNECTIONS, mRaknetPeer->NumberOfConnections());
+	mMetrics->SetGauge(PROJECTILES, mArena->GetNumProjectiles());
+	mMetrics->SetGauge(POOL_SIZE, mBitStreamPool->GetSize());
+	mMetrics->SetGauge(POOL_IN_USE, mBitStreamPool->GetNumInUse());
+	mMetrics->SetGauge(POOL_MAX_IN_USE, mBitStreamPool->GetMaxInUse());
+}
+
+//! The database calls block the server, so they are timed.
+void Server::UpdatePlayerCounter(int change)
+{
+	double startTime = GetMilliseconds();
+	mDatabase->IncrementPlayerCounter(mServerName, change);
+	mMetrics->ObserveDatabaseCall(GetMilliseconds() - startTime);
 }
 
 void Server::Draw(GLib::Graphics* pGraphics)
@@ -99,16 +403,77 @@ void Server::SendClientMessage(RakNet::BitStream& bitstream, bool broadcast, Rak
 {
 	// Send it to all other clients.
 	mRaknetPeer->Send(&bitstream, HIGH_PRIORITY, RELIABLE_ORDERED, 0, adress, broadcast);
+	mMetrics->OnPacketSent(bitstream.GetData()[0], bitstream.GetNumberOfBytesUsed(), broadcast, adress);
+}
+
+//! Unreliable and sent right away, for messages where a resend would arrive too late anyway.
+void Server::SendImmediateMessage(RakNet::BitStream& bitstream, RakNet::SystemAddress adress)
+{
+	mRaknetPeer->Send(&bitstream, IMMEDIATE_PRIORITY, UNRELIABLE, 0, adress, false);
+	mMetrics->OnPacketSent(bitstream.GetData()[0], bitstream.GetNumberOfBytesUsed(), false, adress);
+}
+
+//! Forwards a received packet to the clients right away, sent straight from the packet data.
+//! Held back chat goes first so the order on the channel is kept.
+void Server::RelayPacket(RakNet::Packet* pPacket, bool broadcast, RakNet::SystemAddress adress)
+{
+	FlushDeferredRelays();
+
+	mRaknetPeer->Send((const char*)pPacket->data, pPacket->length, HIGH_PRIORITY, RELIABLE_ORDERED, 0, adress, broadcast);
+	mMetrics->OnPacketSent(pPacket->data[0], pPacket->length, broadcast, adress);
+}
+
+//! Relayed right away, unless the watchdog defers chat. Then the packet is
+//! kept and sent with the other held back chat every DEFERRED_RELAY_INTERVAL.
+void Server::RelayDeferrablePacket(RakNet::Packet* pPacket)
+{
+	if(!mWatchdog->IsDegraded(DEGRADE_CHAT_RELAY))
+		RelayPacket(pPacket);
+	else
+		mDeferredRelays.push_back(pPacket);
+}
+
+//! Sends the held back chat in the order it was received and deallocates the packets.
+void Server::FlushDeferredRelays()
+{
+	for(int i = 0; i < mDeferredRelays.size(); i++)
+	{
+		RakNet::Packet* packet = mDeferredRelays[i];
+		mRaknetPeer->Send((const char*)packet->data, packet->length, HIGH_PRIORITY, RELIABLE_ORDERED, 0, RakNet::UNASSIGNED_SYSTEM_ADDRESS, true);
+		mMetrics->OnPacketSent(packet->data[0], packet->length, true, RakNet::UNASSIGNED_SYSTEM_ADDRESS);
+		mRaknetPeer->DeallocatePacket(packet);
+	}
+
+	mDeferredRelays.clear();
+	mDeferredRelayTime = 0.0f;
 }
 
 void Server::StartGame()
 {
+	// A checkpoint of other players is from an abandoned match.
+	bool resume = mResumingMatch && IsCheckpointForPlayers(mRecoveryCheckpoint);
+	if(mResumingMatch && !resume) {
+		DiscardCheckpoint();
+		gConsole->AddLine("Nobody from the checkpoint is here, starting a new match.");
+	}
+
+	// The round setup uses the cvars of the match.
+	if(resume)
+		RestoreCheckpointCvars(mRecoveryCheckpoint);
+
+	mResumingMatch = false;
 	mRoundHandler->StartRound();
 	mArena->StartGame();
 	mInLobby = false;
 
+	// A rematch goes back to this. It doesn't restore the cvars, so missing ones don't matter.
+	TakeCheckpoint(mMatchStartCheckpoint);
+
+	if(resume)
+		RestoreCheckpoint(mRecoveryCheckpoint);
+
 	RakNet::BitStream bitstream;
-	bitstream.Write((unsigned char)NMSG_GAME_STARTED);
+	GameStartedMessage().Write(bitstream);
 	SendClientMessage(bitstream);
 
 	gConsole->AddLine("Game starting!");
@@ -129,8 +494,12 @@ void Server::DrawScores(GLib::Graphics* pGraphics)
 
 bool Server::StartServer()
 {
+	if(!CheckCvars())
+		return false;
+
 	if(mRaknetPeer->Startup(10, &RakNet::SocketDescriptor(27020, 0), 1) == RakNet::RAKNET_STARTED)	{
 		mRaknetPeer->SetMaximumIncomingConnections(10);
+		mRaknetPeer->SetIncomingDatagramEventHandler(&Server::OnIncomingDatagram);
 		return true;
 	}
 	else
@@ -139,12 +508,77 @@ bool Server::StartServer()
 
 bool Server::ListenForPackets()
 {
+	// Handle all queued packets, frames are far apart when the tick rate is low.
+	if(mReplay->IsPlaying())
+		mReplay->PushDuePackets(mSimulationTick, mRaknetPeer);
+
 	RakNet::Packet *packet = nullptr;
-	packet = mRaknetPeer->Receive();
+	while((packet = mRaknetPeer->Receive()) != nullptr)	{
+		if(mReplay->IsRecording())
+			mReplay->Record(mSimulationTick, packet);
+
+		// Measure the time from the datagram arriving until it's handled. Only
+		// game messages count, RakNet's own messages don't need the loop awake.
+		if(mWakePending && packet->data[0] >= ID_USER_PACKET_ENUM) {
+			LARGE_INTEGER now, frequency;
+			QueryPerformanceCounter(&now);
+			QueryPerformanceFrequency(&frequency);
+			double latency = (now.QuadPart - gDatagramTime.QuadPart) * 1000.0 / frequency.QuadPart;
+
+			mNumWakes++;
+			mTotalWakeLatency += latency;
+			mMaxWakeLatency = max(mMaxWakeLatency, latency);
+		}
+		mWakePending = false;
 
-	if(packet != nullptr)	{
 		HandlePacket(packet);
-		mRaknetPeer->DeallocatePacket(packet);
+		mLastActivityTime = GetTickCount();
+
+		// Held back chat is deallocated once it's sent.
+		bool deferred = !mDeferredRelays.empty() && mDeferredRelays.back() == packet;
+		if(!deferred)
+			mRaknetPeer->DeallocatePacket(packet);
+	}
+
+	// Held back chat goes out when it's due or no longer held back.
+	if(!mDeferredRelays.empty() && (mDeferredRelayTime >= DEFERRED_RELAY_INTERVAL || !mWatchdog->IsDegraded(DEGRADE_CHAT_RELAY)))
+		FlushDeferredRelays();
+
+	return true;
+}
+
+//! Blocks until a datagram arrives, the next timer can fire or IDLE_MAX_WAIT_MS has passed.
+//! RakNet handles the datagram on its own thread, so after waking up the
+//! server stays awake for a while and polls for the packet.
+void Server::WaitForPackets()
+{
+	mWakePending = false;
+	ResetEvent(mDatagramEvent);
+	InterlockedExchange(&gDatagramPending, 0);
+
+	// Timers only fire in a simulation step, waking up before the next one is pointless.
+	float step = 1.0f / TICK_POLICY[mPhase].simulationHz;
+	float wait = max(mTimers->GetTimeUntilNext(IDLE_MAX_WAIT_MS / 1000.0f), step - mSimulationDelta);
+	DWORD timeout = (DWORD)ceilf(min(wait, IDLE_MAX_WAIT_MS / 1000.0f) * 1000.0f);
+	if(WaitForSingleObject(mDatagramEvent, timeout) == WAIT_OBJECT_0) {
+		mWakePending = true;
+		mLastActivityTime = GetTickCount();
+	}
+}
+
+//! Called from RakNet's receive thread for every datagram, wakes up WaitForPackets()
+//! when the datagram can carry messages. Pings, handshakes and acks are handled by RakNet.
+bool Server::OnIncomingDatagram(RakNet::RNS2RecvStruct* pRecvStruct)
+{
+	unsigned char header = pRecvStruct->bytesRead > 0 ? (unsigned char)pRecvStruct->data[0] : 0;
+	if((header & DATAGRAM_VALID) == 0 || (header & (DATAGRAM_ACK | DATAGRAM_NAK)) != 0)
+		return true;
+
+	if(InterlockedExchange(&gDatagramPending, 1) == 0) {
+		QueryPerformanceCounter(&gDatagramTime);
+
+		if(gDatagramEvent != NULL)
+			SetEvent(gDatagramEvent);
 	}
 
 	return true;
@@ -158,16 +592,23 @@ bool Server::HandlePacket(RakNet::Packet* pPacket)
 
 	// Read the packet id.
 	bitstream.Read(packetID);
+	mMetrics->OnPacketReceived(packetID, pPacket->length, pPacket->systemAddress);
+
+	// Drop the messages the client sends faster than it's allowed to.
+	if(!mRateLimiter->Allow(pPacket->systemAddress, packetID))
+		return true;
 
 	// Switch the packet id.
 	switch(packetID)
 	{
 		case ID_NEW_INCOMING_CONNECTION:
-			mDatabase->IncrementPlayerCounter(mServerName, 1);
+			UpdatePlayerCounter(1);
+			AddClient(pPacket->systemAddress);
 			mMessageHandler->HandleNewConnection(bitstream, pPacket->systemAddress);
 			break;
 		case ID_CONNECTION_LOST:
-			mDatabase->IncrementPlayerCounter(mServerName, -1);
+			UpdatePlayerCounter(-1);
+			RemoveClient(pPacket->systemAddress);
 			mMessageHandler->HandleConnectionLost(bitstream, pPacket->systemAddress);
 			break;
 		case NMSG_CLIENT_CONNECTION_DATA:
@@ -177,10 +618,10 @@ bool Server::HandlePacket(RakNet::Packet* pPacket)
 			mMessageHandler->HandleNamesRequest(bitstream, pPacket->systemAddress);
 			break;
 		case NMSG_TARGET_ADDED:
-			mMessageHandler->HandleTargetAdded(bitstream);
+			mMessageHandler->HandleTargetAdded(bitstream, pPacket->systemAddress);
 			break;
 		case NMSG_SKILL_CAST:
-			mMessageHandler->HandleSkillCasted(bitstream);
+			mMessageHandler->HandleSkillCasted(bitstream, pPacket->systemAddress);
 			break;
 		case NMSG_ITEM_ADDED:
 			mMessageHandler->HandleItemAdded(bitstream, pPacket->systemAddress);
@@ -192,7 +633,7 @@ bool Server::HandlePacket(RakNet::Packet* pPacket)
 			mMessageHandler->HandleGoldChange(bitstream, pPacket->systemAddress);
 			break;
 		case NMSG_CHAT_MESSAGE_SENT:
-			mMessageHandler->HandleChatMessage(bitstream, pPacket->systemAddress);
+			mMessageHandler->HandleChatMessage(bitstream, pPacket);
 			break;
 		case NMSG_REQUEST_CVAR_LIST:
 			mMessageHandler->HandleCvarListRequest(bitstream, pPacket->systemAddress);
@@ -203,6 +644,9 @@ bool Server::HandlePacket(RakNet::Packet* pPacket)
 		case NMSG_REQUEST_REMATCH:
 			mMessageHandler->HandleRematchRequest(bitstream);
 			break;
+		case NMSG_TIME_SYNC_REQUEST:
+			mMessageHandler->HandleTimeSyncRequest(bitstream, pPacket->systemAddress);
+			break;
 	}
 
 	return true;
@@ -210,23 +654,46 @@ bool Server::HandlePacket(RakNet::Packet* pPacket)
 
 void Server::AddClientChatText(string text, COLORREF color, bool broadcast, RakNet::SystemAddress adress)
 {
-	// Send cvar change message.
+	// Send add chat text message.
+	AddChatTextMessage message;
+	message.text.Set(text);
+	message.color = color;
+
 	RakNet::BitStream bitstream;
-	bitstream.Write((unsigned char)NMSG_ADD_CHAT_TEXT);
-	bitstream.Write(text.c_str());
-	bitstream.Write(color);
+	message.Write(bitstream);
 	SendClientMessage(bitstream, broadcast, adress);
 }
 
-vector<string> Server::GetConnectedClients()
+void Server::GetConnectedClients(vector<string>& clients)
 {
-	vector<string> clients;
 	vector<Player*>* players = mArena->GetPlayerListPointer();
 
+	clients.resize(players->size());
 	for(int i = 0; i < players->size(); i++)
-		clients.push_back(players->operator[](i)->GetName());
+		clients[i] = players->operator[](i)->GetName();
+}
 
-	return clients;
+//! Every cvar must fit in the checkpoints and its name in the messages, or the
+//! clients and resumed matches would get the wrong cvars. Fails the startup if not.
+bool Server::CheckCvars()
+{
+	char buffer[128];
+	if(mCvars.CvarMap.size() > MAX_CVARS) {
+		sprintf(buffer, "There are %i cvars, raise MAX_CVARS to at least that!", (int)mCvars.CvarMap.size());
+		gConsole->AddLine(buffer);
+		return false;
+	}
+
+	bool fits = true;
+	for(auto iter = mCvars.CvarMap.begin(); iter != mCvars.CvarMap.end(); iter++)
+	{
+		if((*iter).first.size() >= sizeof(CvarString().text)) {
+			gConsole->AddLine("The cvar " + (*iter).first + " has a longer name than CvarString can hold!");
+			fits = false;
+		}
+	}
+
+	return fits;
 }
 
 bool Server::IsCvarCommand(string cmd)
@@ -243,7 +710,41 @@ bool Server::IsCvarCommand(string cmd)
 
 string Server::RemovePlayer(RakNet::SystemAddress adress)
 {
-	return mArena->RemovePlayer(adress);
+	string name = mArena->RemovePlayer(adress);
+
+	// Nobody is left to resume the match with.
+	if(mArena->GetPlayerListPointer()->empty())
+		DiscardCheckpoint();
+
+	return name;
+}
+
+//! Every connection has its own snapshot rate, traffic counters and rate limits.
+void Server::AddClient(RakNet::SystemAddress adress)
+{
+	mSnapshots->AddClient(adress);
+	mMetrics->AddClient(adress);
+	mRateLimiter->AddClient(adress);
+}
+
+void Server::RemoveClient(RakNet::SystemAddress adress)
+{
+	mSnapshots->RemoveClient(adress);
+	mMetrics->RemoveClient(adress);
+	mRateLimiter->RemoveClient(adress);
+}
+
+//! Drops the connection and removes the player the same way as a lost connection.
+void Server::KickClient(RakNet::SystemAddress adress, string reason)
+{
+	gConsole->AddLine("Kicked " + string(adress.ToString()) + ": " + reason);
+
+	mRaknetPeer->CloseConnection(adress, true);
+	UpdatePlayerCounter(-1);
+	RemoveClient(adress);
+
+	RakNet::BitStream bitstream;
+	mMessageHandler->HandleConnectionLost(bitstream, adress);
 }
 
 RakNet::RakPeerInterface* Server::GetRaknetPeer()
@@ -261,16 +762,51 @@ RoundHandler* Server::GetRoundHandler()
 	return mRoundHandler;
 }
 
-bool Server::IsHost(string name)
+//! Gives the player the id the messages refer to it with.
+NameId Server::InternPlayerName(const string& name, int objectId)
+{
+	NameId id = mNames->Add(name, objectId);
+
+	// The host is only compared by name here.
+	if(name == mHostName)
+		mHostNameId = id;
+
+	return id;
+}
+
+void Server::ReleasePlayerName(NameId id)
+{
+	if(id == mHostNameId)
+		mHostNameId = INVALID_NAME_ID;
+
+	mNames->Remove(id);
+}
+
+bool Server::IsHost(NameId id)
 {
-	return mHostName == name;
+	return id != INVALID_NAME_ID && id == mHostNameId;
 }
 
-float Server::GetCvarValue(string cvar)
+//! Looks the cvar up without copying the name, it's read every tick.
+float Server::GetCvarValue(const string& cvar)
 {
+	auto iter = mCvars.CvarMap.find(cvar);
+	if(iter != mCvars.CvarMap.end())
+		return (*iter).second;
+
 	return mCvars.GetCvarValue(cvar);
 }
 
+//! For cvars that don't have to be in cvars.cfg.
+float Server::GetCvarValue(const string& cvar, float defaultValue)
+{
+	auto iter = mCvars.CvarMap.find(cvar);
+	if(iter != mCvars.CvarMap.end())
+		return (*iter).second;
+
+	return defaultValue;
+}
+
 void Server::SetScore(string name, int score)
 {
 	mScoreMap[name] = score;
@@ -302,14 +838,14 @@ CurrentState Server::GetArenaState()
 	return mRoundHandler->GetArenaState().state;
 }
 
-bool Server::IsRoundOver(string& winner)
+bool Server::IsRoundOver(Player*& pWinner)
 {
-	return mRoundHandler->HasRoundEnded(winner);
+	return mRoundHandler->HasRoundEnded(pWinner);
 }
 
 bool Server::IsGameOver()
 {
-	if(mRoundHandler->GetCompletedRounds() >= mCvars.GetCvarValue(Cvars::NUM_ROUNDS))
+	if(mRoundHandler->GetCompletedRounds() >= GetCvarValue(Cvars::NUM_ROUNDS))
 		return true;
 	else
 		return false;
@@ -320,7 +856,7 @@ void Server::AddRoundCompleted()
 	mRoundHandler->AddRoundCompleted();
 }
 
-ServerCvars	Server::GetCvars()
+const ServerCvars& Server::GetCvars()
 {
 	return mCvars;
 }
@@ -330,6 +866,41 @@ ServerArena* Server::GetArena()
 	return mArena;
 }
 
+TimerWheel* Server::GetTimers()
+{
+	return mTimers;
+}
+
+JobSystem* Server::GetJobs()
+{
+	return mJobs;
+}
+
+BitStreamPool* Server::GetBitStreamPool()
+{
+	return mBitStreamPool;
+}
+
+SnapshotScheduler* Server::GetSnapshotScheduler()
+{
+	return mSnapshots;
+}
+
+Metrics* Server::GetMetrics()
+{
+	return mMetrics;
+}
+
+TickWatchdog* Server::GetWatchdog()
+{
+	return mWatchdog;
+}
+
+NameTable* Server::GetNameTable()
+{
+	return mNames;
+}
+
 string Server::GetHostName()
 {
 	return mHostName;
@@ -341,6 +912,123 @@ void Server::ResetScores()
 		(*iter).second = 0;
 }
 
+//! Cheap enough to do every round, the players items are tracked by the arena.
+//! False if the checkpoint is missing cvars, it must not be used then.
+bool Server::TakeCheckpoint(MatchCheckpoint& checkpoint)
+{
+	checkpoint.version = CHECKPOINT_VERSION;
+	checkpoint.completedRounds = mRoundHandler->GetCompletedRounds();
+
+	checkpoint.players.count = 0;
+	vector<Player*>* players = mArena->GetPlayerListPointer();
+	for(int i = 0; i < players->size(); i++)
+	{
+		Player* player = players->operator[](i);
+
+		CheckpointPlayer record;
+		record.name.Set(player->GetName());
+		record.gold = player->GetGold();
+		record.score = mScoreMap[player->GetName()];
+		mArena->GetPlayerItems(player, record.items);
+		checkpoint.players.Add(record);
+	}
+
+	checkpoint.cvars.count = 0;
+	for(auto iter = mCvars.CvarMap.begin(); iter != mCvars.CvarMap.end(); iter++) {
+		CheckpointCvar cvar;
+		cvar.cvar.Set((*iter).first);
+		cvar.value = (*iter).second;
+
+		if(!checkpoint.cvars.Add(cvar)) {
+			gConsole->AddLine("Too many cvars for the checkpoint, raise MAX_CVARS!");
+			return false;
+		}
+	}
+
+	return true;
+}
+
+//! Players are matched by name, the ones not in the checkpoint start fresh.
+//! The cvars are restored separately, before the round is set up.
+void Server::RestoreCheckpoint(const MatchCheckpoint& checkpoint)
+{
+	mRoundHandler->SetCompletedRounds(checkpoint.completedRounds);
+
+	CheckpointItemList noItems;
+	vector<Player*>* players = mArena->GetPlayerListPointer();
+	for(int i = 0; i < players->size(); i++)
+	{
+		Player* player = players->operator[](i);
+		const CheckpointPlayer* record = FindCheckpointPlayer(checkpoint, player->GetName());
+		if(record == nullptr) {
+			player->SetGold(GetCvarValue(Cvars::START_GOLD));
+			mScoreMap[player->GetName()] = 0;
+			mArena->SetPlayerItems(player, noItems);
+			continue;
+		}
+
+		player->SetGold(record->gold);
+		mScoreMap[player->GetName()] = record->score;
+		mArena->SetPlayerItems(player, record->items);
+	}
+}
+
+//! True if any of the connected players is in the checkpoint.
+bool Server::IsCheckpointForPlayers(const MatchCheckpoint& checkpoint)
+{
+	vector<Player*>* players = mArena->GetPlayerListPointer();
+	for(int i = 0; i < players->size(); i++) {
+		if(FindCheckpointPlayer(checkpoint, players->operator[](i)->GetName()) != nullptr)
+			return true;
+	}
+
+	return false;
+}
+
+//! Sets the cvars of the checkpoint and sends the ones that changed to the clients.
+void Server::RestoreCheckpointCvars(const MatchCheckpoint& checkpoint)
+{
+	for(int i = 0; i < checkpoint.cvars.count; i++)
+	{
+		const CheckpointCvar& cvar = checkpoint.cvars.items[i];
+		if(GetCvarValue(cvar.cvar.text) == cvar.value)
+			continue;
+
+		SetCvarValue(cvar.cvar.text, cvar.value);
+		mMessageHandler->SendCvarValue(cvar.cvar.text, (int)cvar.value, false);
+	}
+}
+
+//! The match on disk can't be resumed anymore.
+void Server::DiscardCheckpoint()
+{
+	DeleteCheckpoint(CHECKPOINT_FILE);
+	mResumingMatch = false;
+}
+
+//! Called at the end of every round, a finished game leaves no checkpoint behind.
+void Server::SaveRoundCheckpoint()
+{
+	if(IsGameOver()) {
+		DiscardCheckpoint();
+		return;
+	}
+
+	// A checkpoint without all cvars would resume the match with the wrong ones.
+	if(!TakeCheckpoint(mRoundCheckpoint)) {
+		DiscardCheckpoint();
+		return;
+	}
+
+	if(!SaveCheckpoint(mRoundCheckpoint, CHECKPOINT_FILE))
+		gConsole->AddLine("Failed to save the checkpoint!");
+}
+
+const MatchCheckpoint& Server::GetMatchStartCheckpoint()
+{
+	return mMatchStartCheckpoint;
+}
+
 void Server::StripItems()
 {
 
@@ -349,4 +1037,57 @@ void Server::StripItems()
 bool Server::IsInLobby()
 {
 	return mInLobby;
+}
+
+SimulationPhase Server::GetSimulationPhase()
+{
+	if(mInLobby)
+		return PHASE_LOBBY;
+	else if(IsGameOver())
+		return PHASE_GAME_OVER;
+	else if(mRoundHandler->IsRoundEnded())
+		return PHASE_ROUND_ENDED;
+	else if(GetArenaState() == SHOPPING_STATE)
+		return PHASE_SHOPPING;
+
+	return PHASE_PLAYING;
+}
+
+//! The frame rate the main loop needs to keep up with the current phase.
+float Server::GetFrameRate()
+{
+	if(IsIdle() || mWakePending)
+		return IDLE_FRAME_RATE;
+
+	const TickRates& rates = TICK_POLICY[mPhase];
+	return max(rates.simulationHz, rates.broadcastHz);
+}
+
+//! Idle when no match is running and nothing has arrived for a while.
+bool Server::IsIdle()
+{
+	return mPhase == PHASE_LOBBY && !mRoundHandler->IsLobbyCountdownActive() && GetTickCount() - mLastActivityTime > IDLE_AWAKE_MS;
+}
+
+//! Milliseconds from a datagram waking the server until its game message was handled.
+double Server::GetAverageWakeLatency()
+{
+	return mNumWakes > 0 ? mTotalWakeLatency / mNumWakes : 0.0;
+}
+
+double Server::GetMaxWakeLatency()
+{
+	return mMaxWakeLatency;
+}
+
+//! Simulation steps since the server started.
+unsigned int Server::GetSimulationTick()
+{
+	return mSimulationTick;
+}
+
+//! Milliseconds on the server clock, the clients sync to it.
+unsigned int Server::GetServerTime()
+{
+	return RakNet::GetTimeMS();
 }
\ No newline at end of file
@@ -4,6 +4,9 @@
 #include "States.h"
 #include "ServerCvars.h"
 #include "Database.h"
+#include "TickPolicy.h"
+#include "NameTable.h"
+#include "MatchCheckpoint.h"
 #include <string>
 #include <map>
 
@@ -24,6 +27,19 @@ class Player;
 class ItemLoaderXML;
 class ServerArena;
 class Database;
+class TimerWheel;
+class JobSystem;
+class BitStreamPool;
+class SnapshotScheduler;
+class Metrics;
+class MetricsExporter;
+class TickWatchdog;
+class RateLimiter;
+class MatchReplay;
+
+namespace RakNet {
+	struct RNS2RecvStruct;
+}
 
 class Server
 {
@@ -32,26 +48,53 @@ public:
 	~Server();
 
 	void Update(GLib::Input* pInput, float dt);
+	void Simulate(GLib::Input* pInput, float dt);
 	void Draw(GLib::Graphics* pGraphics);
 	bool StartServer();
 	bool ListenForPackets();
 	bool HandlePacket(RakNet::Packet* pPacket);
+	void WaitForPackets();
+	void CheckTickAllocations(unsigned int countBefore);
+	bool IsReplayFinished();
+	int	 ReportReplayAllocations();
+	void UpdateMetricGauges();
+	void UpdatePlayerCounter(int change);
+	static bool OnIncomingDatagram(RakNet::RNS2RecvStruct* pRecvStruct);
 
 	void SendClientMessage(RakNet::BitStream& bitstream, bool broadcast = true, RakNet::SystemAddress adress = RakNet::UNASSIGNED_SYSTEM_ADDRESS);
+	void SendImmediateMessage(RakNet::BitStream& bitstream, RakNet::SystemAddress adress);
+	void RelayPacket(RakNet::Packet* pPacket, bool broadcast = true, RakNet::SystemAddress adress = RakNet::UNASSIGNED_SYSTEM_ADDRESS);
+	void RelayDeferrablePacket(RakNet::Packet* pPacket);
+	void FlushDeferredRelays();
 	void AddClientChatText(string text, COLORREF color, bool broadcast = true, RakNet::SystemAddress adress = RakNet::UNASSIGNED_SYSTEM_ADDRESS);
 
 	RakNet::RakPeerInterface*	GetRaknetPeer();
-	vector<string>				GetConnectedClients();
 	GLib::World*				GetWorld();
 	RoundHandler*				GetRoundHandler();
 	ServerSkillInterpreter*		GetSkillInterpreter();
 	ItemLoaderXML*				GetItemLoader();
 	CurrentState				GetArenaState();
-	ServerCvars					GetCvars();
+	const ServerCvars&			GetCvars();
 	ServerArena*				GetArena();
+	TimerWheel*					GetTimers();
+	JobSystem*					GetJobs();
+	BitStreamPool*				GetBitStreamPool();
+	SnapshotScheduler*			GetSnapshotScheduler();
+	Metrics*					GetMetrics();
+	TickWatchdog*				GetWatchdog();
+	NameTable*					GetNameTable();
 	string						GetHostName();
-	float						GetCvarValue(string cvar);
+	float						GetCvarValue(const string& cvar);
+	float						GetCvarValue(const string& cvar, float defaultValue);
 	bool						IsInLobby();
+	SimulationPhase				GetSimulationPhase();
+	float						GetFrameRate();
+	double						GetAverageWakeLatency();
+	double						GetMaxWakeLatency();
+	bool						IsIdle();
+	unsigned int				GetSimulationTick();
+	unsigned int				GetServerTime();
+	void						GetConnectedClients(vector<string>& clients);
 
 	void StartGame();
 	void SetGameSate(CurrentState state);
@@ -61,14 +104,29 @@ public:
 	void AddRoundCompleted();
 	void SetCvarValue(string cvar, float value);
 	void ResetScores();
+	bool TakeCheckpoint(MatchCheckpoint& checkpoint);
+	void RestoreCheckpoint(const MatchCheckpoint& checkpoint);
+	void SaveRoundCheckpoint();
+	const MatchCheckpoint& GetMatchStartCheckpoint();
 	string RemovePlayer(RakNet::SystemAddress adress);
+	void KickClient(RakNet::SystemAddress adress, string reason);
 	void StripItems();
 
-	bool IsHost(string name);
+	NameId InternPlayerName(const string& name, int objectId);
+	void ReleasePlayerName(NameId id);
+
+	bool IsHost(NameId id);
 	bool IsCvarCommand(string cmd);
-	bool IsRoundOver(string& winner);
+	bool IsRoundOver(Player*& pWinner);
 	bool IsGameOver();
 private:
+	void AddClient(RakNet::SystemAddress adress);
+	void RemoveClient(RakNet::SystemAddress adress);
+	bool CheckCvars();
+	bool IsCheckpointForPlayers(const MatchCheckpoint& checkpoint);
+	void RestoreCheckpointCvars(const MatchCheckpoint& checkpoint);
+	void DiscardCheckpoint();
+
 	RakNet::RakPeerInterface*	mRaknetPeer;
 	ServerSkillInterpreter*		mSkillInterpreter;
 	ServerMessageHandler*		mMessageHandler;
@@ -76,6 +134,19 @@ private:
 	ItemLoaderXML*				mItemLoader;
 	ServerArena*				mArena;
 	ServerCvars					mCvars;
+	TimerWheel*					mTimers;
+	JobSystem*					mJobs;
+	BitStreamPool*				mBitStreamPool;
+	SnapshotScheduler*			mSnapshots;
+	Metrics*					mMetrics;
+	MetricsExporter*			mMetricsExporter;
+	TickWatchdog*				mWatchdog;
+	RateLimiter*				mRateLimiter;
+	NameTable*					mNames;
+	NameId						mHostNameId;
+
+	vector<RakNet::Packet*>		mDeferredRelays;	// Chat held back while the server is overloaded, kept alive until sent.
+	float						mDeferredRelayTime;
 
 	Database*					mDatabase;
 	string						mServerName;
@@ -83,4 +154,28 @@ private:
 
 	bool						mInLobby;
 	map<string, int>			mScoreMap;
+
+	// Checkpoints.
+	MatchCheckpoint				mMatchStartCheckpoint;	// Restored on rematch.
+	MatchCheckpoint				mRecoveryCheckpoint;	// From the last run, restored when the game starts.
+	MatchCheckpoint				mRoundCheckpoint;		// Saved at the end of every round.
+	bool						mResumingMatch;
+
+	SimulationPhase				mPhase;
+	unsigned int				mSimulationTick;
+	float						mSimulationDelta;
+	float						mBroadcastDelta;
+
+	// Idle mode.
+	HANDLE						mDatagramEvent;
+	DWORD						mLastActivityTime;
+	bool						mWakePending;
+	int							mNumWakes;
+	double						mTotalWakeLatency;
+	double						mMaxWakeLatency;
+
+	// Allocation checks, only with WARLOCK_COUNT_ALLOCATIONS.
+	int							mNumPlayingTicks;
+	int							mNumAllocatingTicks;
+	MatchReplay*				mReplay;
 };
\ No newline at end of file
@@ -1,5 +1,8 @@
 #include "ServerArena.h"
 #include "CollisionHandler.h"
+#include "SpatialHash.h"
+#include "SweepHistory.h"
+#include "JobSystem.h"
 #include "Server.h"
 #include "World.h"
 #include "Object3D.h"
@@ -13,6 +16,36 @@
 #include "ItemLoaderXML.h"
 #include "Effects.h"
 #include "Console.h"
+#include "TimerWheel.h"
+#include "BitStreamPool.h"
+#include "SnapshotScheduler.h"
+#include "Metrics.h"
+#include "TickWatchdog.h"
+#include "Actor.h"
+#include <algorithm>
+#include <type_traits>
+
+// Seconds between lava damage ticks.
+static const float	LAVA_DAMAGE_INTERVAL = 0.1f;
+
+// Seconds it takes for the lava to flood.
+static const float	FLOOD_DURATION = 5.0f;
+
+// Collision grid size relative to the arena radius.
+static const float	COLLISION_GRID_SCALE = 1.5f;
+static const int	COLLISION_GRID_CELLS = 16;
+
+// Occupied grid cells handled by each collision job.
+static const int	COLLISION_CELLS_PER_JOB = 16;
+
+// Most players and projectiles whose last position is kept for the sweep.
+static const int	MAX_SWEPT_OBJECTS = 512;
+
+//! True if a comes after b, the sequence numbers wrap around.
+static bool IsNewerSequence(InputSequence a, InputSequence b)
+{
+	return (short)(a - b) > 0;
+}
 
 ServerArena::ServerArena(Server* pServer)
 	: BaseArena()
@@ -21,15 +54,21 @@ ServerArena::ServerArena(Server* pServer)
 
 	mWorld->AddObjectAddedListener(&ServerArena::OnObjectAdded, this);
 	mWorld->AddObjectRemovedListener(&ServerArena::OnObjectRemoved, this);
-	mWorld->AddObjectCollisionListener(&ServerArena::OnObjectCollision, this);
 
+	// Collisions are found by the spatial hash in UpdateCollisions() instead of the World.
 	mCollisionHandler = new CollisionHandler();
+	mSpatialHash = new SpatialHash();
+	mSweeps = new SweepHistory(MAX_SWEPT_OBJECTS);
+
+	// Callbacks for each layer pair, indexed with the lower layer first.
+	for(int i = 0; i < NUM_COLLISION_LAYERS; i++)
+		for(int j = 0; j < NUM_COLLISION_LAYERS; j++)
+			mCollisionCallbacks[i][j] = nullptr;
 
-	mTickRate = 1.0f / 60.0f;	// 100 ticks per second.
-	mTickCounter = 0.0f;
-	mDamageCounter = 0.0f;
-	mFloodDelta = 0.0f;
+	mCollisionCallbacks[COLLISION_LAYER_PLAYER][COLLISION_LAYER_PROJECTILE] = &ServerArena::OnPlayerProjectileCollision;
+	mCollisionCallbacks[COLLISION_LAYER_PROJECTILE][COLLISION_LAYER_PROJECTILE] = &ServerArena::OnProjectileProjectileCollision;
 
+	mFlooding = false;
 	mGameStarted = false;
 
 	/************************************************************************/
@@ -47,128 +86,282 @@ ServerArena::ServerArena(Server* pServer)
 	GLib::Effects::TerrainFX->SetArenaRadius(60);
 
 	mArenaRadius = mServer->GetCvarValue(Cvars::ARENA_RADIUS);
+	mSpatialHash->Init(mArenaRadius * COLLISION_GRID_SCALE, COLLISION_GRID_CELLS);
 }
 
 ServerArena::~ServerArena()
 {
+	mServer->GetTimers()->Cancel(mLavaTimer);
+	mServer->GetTimers()->Cancel(mFloodTimer);
+
 	delete mCollisionHandler;
+	delete mSpatialHash;
+	delete mSweeps;
 }
 
 void ServerArena::Update(GLib::Input* pInput, float dt)
 {
 	if(!IsGameStarted())
 		return;
-	
-	mDamageCounter += dt;
 
-	for(int i = 0; i < mPlayerList.size(); i++) 
+	// Only players that took damage since the last tick or have status effects can have died.
+	for(int i = 0; i < mAfflictedPlayers.size(); i++)
+		OnPlayerDamaged(mAfflictedPlayers[i]);
+
+	for(int i = 0; i < mDamagedPlayers.size(); i++) 
 	{
-		if(mPlayerList[i]->GetEliminated())
+		Player* player = mDamagedPlayers[i];
+		if(player->GetEliminated())
 			continue;
 
-		// Deal damage to players outside the arena.
-		if(mDamageCounter > 0.1f)
-		{
-			XMFLOAT3 pos = mPlayerList[i]->GetPosition();
-			float distFromCenter = sqrt(pos.x * pos.x + pos.z * pos.z);
-
-			// Arena is 60 units in radius.
-			if(distFromCenter > mArenaRadius) {
-				mPlayerList[i]->TakeDamage(mServer->GetCvarValue(Cvars::LAVA_DMG) * (1 - mPlayerList[i]->GetLavaImmunity()));
-
-				// Set slow movement speed.
-				mPlayerList[i]->SetSlow(mServer->GetCvarValue(Cvars::LAVA_SLOW));
-			}
-			else {
-				// Restore movement speed.
-				mPlayerList[i]->SetSlow(0.0f);
-			}
-		}
-		
 		// Player dead?
-		if(mPlayerList[i]->GetCurrentHealth() <= 0 && mPlayerList[i]->GetCurrentAnimation() != 7) {
-			static int cc = 0;
-			cc++;
-			if(cc == 1)
-				int a = 1;
-
-			mPlayerList[i]->SetDeathAnimation();
-			PlayerEliminated(mPlayerList[i], mPlayerList[i]->GetLastHitter());
+		if(player->GetCurrentHealth() <= 0 && player->GetCurrentAnimation() != 7) {
+			player->SetDeathAnimation();
+			PlayerEliminated(player, player->GetLastHitter());
 		}
 	}
 
+	mDamagedPlayers.clear();
+
+	// The World still tests every pair of boxes after moving and removing the objects.
+	// Nothing listens to its collisions and the pass can't be switched off from here,
+	// but it's cheap next to the tick: about 80 us at 256 objects against 25 us for
+	// UpdateCollisions(), see tests/SpatialHashBenchmark.cpp.
 	mWorld->Update(dt);
+	UpdateCollisions();
 
-	if(mDamageCounter > 0.1f)
-		mDamageCounter = 0.0f;
+	// Find out if there is only 1 player alive (round ended).
+	Player* winner = nullptr;
+	if(mServer->IsRoundOver(winner))
+	{
+		mServer->AddRoundCompleted();
 
-	// Broadcast the world at a fixed rate.
-	mTickCounter += dt;
-	if(mTickCounter > mTickRate) {
-		// Find out if there is only 1 player alive (round ended).
-		string winner;
-		if(mServer->IsRoundOver(winner))
-		{
-			mServer->AddRoundCompleted();
+		RemoveStatusEffects();
+
+		for(int i = 0; i < mPlayerList.size(); i++)
+			mPlayerList[i]->SetGold(mPlayerList[i]->GetGold() + mServer->GetCvarValue(Cvars::GOLD_PER_ROUND));
+
+		// Add extra gold to the winner.
+		if(winner != nullptr)
+			winner->SetGold(winner->GetGold() + mServer->GetCvarValue(Cvars::GOLD_PER_WIN));
+
+		NameId winnerId = winner != nullptr ? mServer->GetNameTable()->GetId(winner->GetId()) : INVALID_NAME_ID;
+
+		RakNet::BitStream bitstream;
+		if(mServer->IsGameOver()) {
+			GameOverMessage message;
+			message.winner = winnerId;
+			message.Write(bitstream);
+		}
+		else {
+			RoundEndedMessage message;
+			message.winner = winnerId;
+			message.Write(bitstream);
+		}
+
+		mServer->SendClientMessage(bitstream);
 
-			RemoveStatusEffects();
+		// Increment winners score.
+		if(winner != nullptr) {
+			mServer->AddScore(winner->GetName(), 1);
+			gConsole->AddLine(winner->GetName() + " wins the round!");
+		}
+		else
+			gConsole->AddLine("Nobody wins the round!");
 
-			for(int i = 0; i < mPlayerList.size(); i++)
-				mPlayerList[i]->SetGold(mPlayerList[i]->GetGold() + mServer->GetCvarValue(Cvars::GOLD_PER_ROUND));
+		mServer->SaveRoundCheckpoint();
+	}
 
-			// Add extra gold to the winner.
-			Player* winningPlayer = (Player*)mWorld->GetObjectByName(winner);
-			winningPlayer->SetGold(winningPlayer->GetGold() + mServer->GetCvarValue(Cvars::GOLD_PER_WIN));
+	// Shrink the arena while flooding.
+	if(mFlooding)
+	{
+		float progress = 1.0f - mServer->GetTimers()->GetTimeLeft(mFloodTimer) / FLOOD_DURATION;
+		SetArenaRadius(mArenaFloodStartRadius - mServer->GetCvarValue(Cvars::FLOOD_SIZE) * progress);
+	}
+}
 
-			RakNet::BitStream bitstream;
-			if(mServer->IsGameOver())
-				bitstream.Write((unsigned char)NMSG_GAME_OVER);
-			else 
-				bitstream.Write((unsigned char)NMSG_ROUND_ENDED);
+//! Deals damage to the players outside the arena, runs every LAVA_DAMAGE_INTERVAL seconds.
+//! mPlayersInLava holds the players that were in the lava last time, the slow is
+//! only restored on the way out.
+void ServerArena::ApplyLavaDamage()
+{
+	float radiusSq = mArenaRadius * mArenaRadius;
+	float damage = mServer->GetCvarValue(Cvars::LAVA_DMG);
+	float slow = mServer->GetCvarValue(Cvars::LAVA_SLOW);
 
-			bitstream.Write(winner.c_str());
-			mServer->SendClientMessage(bitstream);
+	for(int i = 0; i < mPlayerList.size(); i++) 
+	{
+		Player* player = mPlayerList[i];
+		if(player->GetEliminated())
+			continue;
 
-			// Increment winners score.
-			mServer->AddScore(winner, 1);
+		XMFLOAT3 pos = player->GetPosition();
+		bool inLava = pos.x * pos.x + pos.z * pos.z > radiusSq;
+		auto iter = find(mPlayersInLava.begin(), mPlayersInLava.end(), player);
 
-			gConsole->AddLine(winner + " wins the round!");
+		if(!inLava) {
+			// Restore movement speed.
+			if(iter != mPlayersInLava.end()) {
+				mPlayersInLava.erase(iter);
+				player->SetSlow(0.0f);
+			}
+			continue;
 		}
 
-		BroadcastWorld();
-		mServer->GetRoundHandler()->BroadcastStateTimer();
-		mTickCounter = 0.0f;
+		if(iter == mPlayersInLava.end())
+			mPlayersInLava.push_back(player);
+
+		player->TakeDamage(damage * (1 - player->GetLavaImmunity()));
+		OnPlayerDamaged(player);
+
+		// Set slow movement speed.
+		player->SetSlow(slow);
 	}
+}
 
-	// Update lava.
-	mFloodDelta += dt;
+void ServerArena::OnPlayerItemAdded(Player* pPlayer, ItemName item, int level)
+{
+	CheckpointItem entry;
+	entry.item = item;
+	entry.level = level;
+	mPlayerItems[pPlayer->GetId()].push_back(entry);
+}
 
-	if(mFloodDelta >= mServer->GetCvarValue(Cvars::FLOOD_INTERVAL))
+void ServerArena::OnPlayerItemRemoved(Player* pPlayer, ItemName item, int level)
+{
+	vector<CheckpointItem>& items = mPlayerItems[pPlayer->GetId()];
+	for(int i = 0; i < items.size(); i++) {
+		if(items[i].item == item && items[i].level == level) {
+			items.erase(items.begin() + i);
+			break;
+		}
+	}
+}
+
+//! Gives the player the items and tells all clients about it. Only the
+//! differences are sent, the items the player has already are kept.
+void ServerArena::SetPlayerItems(Player* pPlayer, const CheckpointItemList& items)
+{
+	ItemLoaderXML* itemLoader = mServer->GetItemLoader();
+	vector<CheckpointItem>& current = mPlayerItems[pPlayer->GetId()];
+	RakNet::BitStream bitstream;
+
+	// The items to add, the ones the player has are crossed off below.
+	bool missing[MAX_CHECKPOINT_ITEMS];
+	for(int i = 0; i < items.count; i++)
+		missing[i] = true;
+
+	for(int i = 0; i < current.size();)
 	{
-		mArenaFloodStartRadius = mArenaRadius;
-		mFloodDelta = -5;
+		bool keep = false;
+		for(int j = 0; j < items.count && !keep; j++) {
+			if(missing[j] && items.items[j].item == current[i].item && items.items[j].level == current[i].level) {
+				missing[j] = false;
+				keep = true;
+			}
+		}
 
-		// Send NMSG_FLOOD_START message.
-		RakNet::BitStream bitstream;
-		bitstream.Write((unsigned char)NMSG_FLOOD_START);
+		if(keep) {
+			i++;
+			continue;
+		}
+
+		pPlayer->RemoveItem(itemLoader->GetItem(ItemKey(current[i].item, current[i].level)));
+
+		ItemRemovedMessage message;
+		message.playerId = pPlayer->GetId();
+		message.item = current[i].item;
+		message.level = current[i].level;
+
+		bitstream.Reset();
+		message.Write(bitstream);
 		mServer->SendClientMessage(bitstream);
 
-		gConsole->AddLine("Lava flood started!");
+		current.erase(current.begin() + i);
 	}
-	else if(mFloodDelta < 0)
+
+	for(int i = 0; i < items.count; i++)
 	{
-		float floadSize = mServer->GetCvarValue(Cvars::FLOOD_SIZE);
-		mArenaRadius = mArenaFloodStartRadius - floadSize * (1 - (-mFloodDelta / 5));
-		GLib::Effects::TerrainFX->SetArenaRadius(mArenaRadius);
+		if(!missing[i])
+			continue;
 
-		// Send NMSG_ARENA_RADIUS message.
-		RakNet::BitStream bitstream;
-		bitstream.Write((unsigned char)NMSG_ARENA_RADIUS);
-		bitstream.Write(mArenaRadius);
+		pPlayer->AddItem(itemLoader, ItemKey(items.items[i].item, items.items[i].level));
+		current.push_back(items.items[i]);
+
+		ItemAddedMessage message;
+		message.playerId = pPlayer->GetId();
+		message.item = items.items[i].item;
+		message.level = items.items[i].level;
+
+		bitstream.Reset();
+		message.Write(bitstream);
 		mServer->SendClientMessage(bitstream);
 	}
 }
 
+void ServerArena::GetPlayerItems(Player* pPlayer, CheckpointItemList& items)
+{
+	items.count = 0;
+
+	auto iter = mPlayerItems.find(pPlayer->GetId());
+	if(iter == mPlayerItems.end())
+		return;
+
+	for(int i = 0; i < (*iter).second.size(); i++)
+		items.Add((*iter).second[i]);
+}
+
+//! Marks the player to be checked for death next tick.
+void ServerArena::OnPlayerDamaged(Player* pPlayer)
+{
+	if(find(mDamagedPlayers.begin(), mDamagedPlayers.end(), pPlayer) == mDamagedPlayers.end())
+		mDamagedPlayers.push_back(pPlayer);
+}
+
+//! Starts shrinking the arena, runs every FLOOD_INTERVAL seconds.
+void ServerArena::StartFlood()
+{
+	mArenaFloodStartRadius = mArenaRadius;
+	mFlooding = true;
+	mFloodTimer = mServer->GetTimers()->Schedule(FLOOD_DURATION, [this]() { EndFlood(); });
+
+	RakNet::BitStream bitstream;
+	FloodStartMessage().Write(bitstream);
+	mServer->SendClientMessage(bitstream);
+
+	gConsole->AddLine("Lava flood started!");
+}
+
+void ServerArena::EndFlood()
+{
+	mFlooding = false;
+	SetArenaRadius(mArenaFloodStartRadius - mServer->GetCvarValue(Cvars::FLOOD_SIZE));
+	mFloodTimer = mServer->GetTimers()->Schedule(mServer->GetCvarValue(Cvars::FLOOD_INTERVAL), [this]() { StartFlood(); });
+}
+
+void ServerArena::SetArenaRadius(float radius)
+{
+	mArenaRadius = radius;
+	GLib::Effects::TerrainFX->SetArenaRadius(mArenaRadius);
+
+	ArenaRadiusMessage message;
+	message.radius = mArenaRadius;
+
+	RakNet::BitStream bitstream;
+	message.Write(bitstream);
+	mServer->SendClientMessage(bitstream);
+}
+
+//! Sends the world to the due clients and the state timer, called at the broadcast rate of the current phase.
+void ServerArena::BroadcastTick()
+{
+	if(!IsGameStarted())
+		return;
+
+	SendSnapshot(mServer->GetSnapshotScheduler());
+	mServer->GetRoundHandler()->BroadcastStateTimer();
+}
+
 void ServerArena::Draw(GLib::Graphics* pGraphics)
 {
 	if(IsGameStarted())
@@ -181,12 +374,18 @@ void ServerArena::RemoveStatusEffects()
 {
 	for(int i = 0; i < mPlayerList.size(); i++) 
 		mPlayerList[i]->RemoveStatusEffects();
+
+	mAfflictedPlayers.clear();
 }
 
 void ServerArena::StartGame()
 {
 	mGameStarted = true;
 
+	TimerWheel* timers = mServer->GetTimers();
+	timers->Cancel(mLavaTimer);
+	mLavaTimer = timers->ScheduleRepeating(LAVA_DAMAGE_INTERVAL, [this]() { ApplyLavaDamage(); });
+
 	for(int i = 0; i < mPlayerList.size(); i++) 
 		mPlayerList[i]->SetGold(mServer->GetCvarValue(Cvars::START_GOLD));
 }
@@ -195,41 +394,121 @@ void ServerArena::StartRound()
 {
 	mArenaRadius = mServer->GetCvarValue(Cvars::ARENA_RADIUS);
 	GLib::Effects::TerrainFX->SetArenaRadius(mArenaRadius);
-	mFloodDelta = 0.0f;
+
+	// Restart the flood timer.
+	TimerWheel* timers = mServer->GetTimers();
+	timers->Cancel(mFloodTimer);
+	mFlooding = false;
+	mFloodTimer = timers->Schedule(mServer->GetCvarValue(Cvars::FLOOD_INTERVAL), [this]() { StartFlood(); });
+
+	// The grid covers the arena and some of the lava around it.
+	mSpatialHash->Init(mArenaRadius * COLLISION_GRID_SCALE, COLLISION_GRID_CELLS);
+
+	// Players get moved to their spawn, don't sweep them there.
+	mSweeps->Clear();
+
+	// The round handler removes all status effects, resets the players and spawns them inside the arena.
+	mAfflictedPlayers.clear();
+	mDamagedPlayers.clear();
+	mPlayersInLava.clear();
 }
 
+//! Sends the whole world to all clients, used when everyone needs the same state right away.
 void ServerArena::BroadcastWorld()
 {
+	// One stream is reused for all objects.
+	BitStreamPool* pool = mServer->GetBitStreamPool();
+	RakNet::BitStream* bitstream = pool->Acquire();
+
+	// Stamp the snapshot so the clients can place it on the server clock.
+	WriteSnapshotBegin(*bitstream);
+	mServer->SendClientMessage(*bitstream);
+
 	// Broadcast world data at a set tickrate.
 	GLib::ObjectList* objects = mWorld->GetObjects();
 	for(auto iter = objects->begin(); iter != objects->end(); iter++)
 	{
-		GLib::Object3D* object = (*iter);
-		XMFLOAT3 pos = object->GetPosition();
-		XMFLOAT3 rotation = object->GetRotation();
+		WriteWorldUpdate(*iter, *bitstream);
+		mServer->SendClientMessage(*bitstream);
+	}
 
-		RakNet::BitStream bitstream;
-		bitstream.Write((unsigned char)NMSG_WORLD_UPDATE);
-		bitstream.Write(object->GetType());
-		bitstream.Write(object->GetId());
-		bitstream.Write(pos.x);
-		bitstream.Write(pos.y);
-		bitstream.Write(pos.z);
-		bitstream.Write(rotation.x);
-		bitstream.Write(rotation.y);
-		bitstream.Write(rotation.z);
+	pool->Release(bitstream);
+}
 
-		if(object->GetType() == GLib::PLAYER)
-		{
-			Player* player = (Player*)object;
-			bitstream.Write(player->GetCurrentAnimation());
-			bitstream.Write(player->GetDeathTimer());
-			bitstream.Write(player->GetCurrentHealth());
-			bitstream.Write(player->GetGold());
-			bitstream.Write(player->GetEliminated() ? 1 : 0);
+//! Sends the world to the clients that are due for a snapshot. Clients on a
+//! slow link only get the players, the projectiles are predicted from their cast.
+void ServerArena::SendSnapshot(SnapshotScheduler* pScheduler)
+{
+	BitStreamPool* pool = mServer->GetBitStreamPool();
+	RakNet::BitStream* bitstream = pool->Acquire();
+
+	WriteSnapshotBegin(*bitstream);
+	for(int i = 0; i < pScheduler->GetNumClients(); i++) {
+		if(pScheduler->IsDue(i))
+			mServer->SendClientMessage(*bitstream, false, pScheduler->GetAdress(i));
+	}
+
+	// Each update is written once and sent to every due client.
+	GLib::ObjectList* objects = mWorld->GetObjects();
+	for(auto iter = objects->begin(); iter != objects->end(); iter++)
+	{
+		GLib::Object3D* object = (*iter);
+		bool player = object->GetType() == GLib::PLAYER;
+		WriteWorldUpdate(object, *bitstream);
+
+		for(int i = 0; i < pScheduler->GetNumClients(); i++) {
+			if(pScheduler->IsDue(i) && (player || pScheduler->IsFullDetail(i)))
+				mServer->SendClientMessage(*bitstream, false, pScheduler->GetAdress(i));
 		}
+	}
 
-		mServer->SendClientMessage(bitstream);
+	pool->Release(bitstream);
+}
+
+void ServerArena::WriteSnapshotBegin(RakNet::BitStream& bitstream)
+{
+	SnapshotBeginMessage snapshot;
+	snapshot.serverTick = mServer->GetSimulationTick();
+	snapshot.serverTime = mServer->GetServerTime();
+
+	bitstream.Reset();
+	snapshot.Write(bitstream);
+}
+
+// The player update used to write the getters as they are, its fields must keep their types.
+#define CHECK_PLAYER_UPDATE_FIELD(field, getter) \
+	static_assert(is_same<decltype(PlayerUpdate::field), decay<decltype(((Player*)nullptr)->getter())>::type>::value, \
+		"PlayerUpdate::" #field " must have the type of Player::" #getter "()");
+CHECK_PLAYER_UPDATE_FIELD(animation, GetCurrentAnimation)
+CHECK_PLAYER_UPDATE_FIELD(deathTimer, GetDeathTimer)
+CHECK_PLAYER_UPDATE_FIELD(health, GetCurrentHealth)
+CHECK_PLAYER_UPDATE_FIELD(gold, GetGold)
+static_assert(sizeof(GLib::ObjectType) == sizeof(int), "WorldUpdateMessage::type must have the size of GLib::ObjectType");
+
+//! Writes the NMSG_WORLD_UPDATE message for an object.
+void ServerArena::WriteWorldUpdate(GLib::Object3D* pObject, RakNet::BitStream& bitstream)
+{
+	WorldUpdateMessage message;
+	message.type = pObject->GetType();
+	message.objectId = pObject->GetId();
+	message.position = pObject->GetPosition();
+	message.rotation = pObject->GetRotation();
+
+	bitstream.Reset();
+	message.Write(bitstream);
+
+	if(pObject->GetType() == GLib::PLAYER)
+	{
+		Player* player = (Player*)pObject;
+
+		PlayerUpdate update;
+		update.animation = player->GetCurrentAnimation();
+		update.deathTimer = player->GetDeathTimer();
+		update.health = player->GetCurrentHealth();
+		update.gold = player->GetGold();
+		update.eliminated = player->GetEliminated() ? 1 : 0;
+		update.lastInput = GetLastInputSequence(player);
+		update.WriteFields(bitstream);
 	}
 }
 
@@ -237,8 +516,10 @@ void ServerArena::BroadcastWorld()
 void ServerArena::OnObjectAdded(GLib::Object3D* pObject)
 {
 	// Add player to mPlayerList.
-	if(pObject->GetType() == GLib::PLAYER)
+	if(pObject->GetType() == GLib::PLAYER) {
 		mPlayerList.push_back((Player*)pObject);
+		mServer->GetRoundHandler()->OnPlayerAdded((Player*)pObject);
+	}
 }
 
 //! Gets called in World::RemoveObject().
@@ -248,76 +529,192 @@ void ServerArena::OnObjectRemoved(GLib::Object3D* pObject)
 	if(pObject->GetType() == GLib::PLAYER) 
 		RemovePlayer(pObject->GetId());
 
+	// The id can be reused by a new object.
+	mSweeps->Forget(pObject->GetId());
+
+	// Sent with the other removals of the tick in FlushRemovedObjects().
+	if(!mRemovedObjects.objectIds.Add(pObject->GetId())) {
+		FlushRemovedObjects();
+		mRemovedObjects.objectIds.Add(pObject->GetId());
+	}
+}
+
+//! Tells the clients about the objects removed since the last flush in one message.
+void ServerArena::FlushRemovedObjects()
+{
+	if(mRemovedObjects.objectIds.count == 0)
+		return;
+
+	RakNet::BitStream* bitstream = mServer->GetBitStreamPool()->Acquire();
+	mRemovedObjects.Write(*bitstream);
+	mServer->SendClientMessage(*bitstream);
+	mServer->GetBitStreamPool()->Release(bitstream);
+
+	mRemovedObjects.objectIds.count = 0;
+}
+
+void ServerArena::OnPlayerProjectileCollision(GLib::Object3D* pPlayer, GLib::Object3D* pProjectile)
+{
+	Player* player = (Player*)pPlayer;
+	Projectile* projectile = (Projectile*)pProjectile;
+
+	if(mServer->GetArenaState() != SHOPPING_STATE && !player->GetEliminated())
+	{
+		// Checks what skill the projectile is and uses the XML data to determine the skill attributes
+		// depending on the skill level.
+		projectile->HandlePlayerCollision(player, this, mServer->GetItemLoader());
+
+		// Add status effect if there is any.
+		StatusEffect* statusEffect = projectile->GetStatusEffect(mServer->GetItemLoader());
+		if(statusEffect != nullptr) {
+			player->AddStatusEffect(statusEffect);
+
+			// Status effects can deal damage over time.
+			if(find(mAfflictedPlayers.begin(), mAfflictedPlayers.end(), player) == mAfflictedPlayers.end())
+				mAfflictedPlayers.push_back(player);
+		}
+
+		OnPlayerDamaged(player);
+
+		// Set hurt animation.
+		if(player->GetCurrentAnimation() != 7) // Death animation
+			player->SetAnimation(6, 0.4f);
+
+		// Add lifesteal life.
+		Player* owner = (Player*)mWorld->GetObjectById(projectile->GetOwner());
+		owner->SetCurrentHealth(owner->GetCurrentHealth() + owner->GetLifeSteal());
+
+		// Let the clients now about the changes immediately.
+		BroadcastWorld();
+
+		// Tell all clients about the collision.
+		ProjectilePlayerCollisionMessage message;
+		message.projectileId = projectile->GetId();
+		message.playerId = player->GetId();
+
+		RakNet::BitStream* bitstream = mServer->GetBitStreamPool()->Acquire();
+		message.Write(*bitstream);
+		mServer->SendClientMessage(*bitstream);
+		mServer->GetBitStreamPool()->Release(bitstream);
+
+		if(gConsole->IsVerbose()) {
+			char buffer[64];
+			sprintf(buffer, "Projectile - Player collision (%i, %i)", player->GetId(), projectile->GetId());
+			gConsole->AddLine(buffer);
+		}
+	}
+
+	// Remove the projectile.
+	projectile->Kill();
+}
+
+//! Only called for projectiles with different owners.
+void ServerArena::OnProjectileProjectileCollision(GLib::Object3D* pProjectileA, GLib::Object3D* pProjectileB)
+{
+	pProjectileA->Kill();
+	pProjectileB->Kill();
+
+	// Tell all clients about the collision.
 	RakNet::BitStream bitstream;
-	bitstream.Write((unsigned char)NMSG_OBJECT_REMOVED);
-	bitstream.Write(pObject->GetId());
+	ProjectileProjectileCollisionMessage().Write(bitstream);
 	mServer->SendClientMessage(bitstream);
 }
 
-void ServerArena::OnObjectCollision(GLib::Object3D* pObjectA, GLib::Object3D* pObjectB)
+//! Broad-phase with the spatial hash, then swept sphere tests on the candidate pairs only.
+//! The collision callbacks are always called from this thread.
+//! Objects outside the collision layers (static objects etc.) are never inserted.
+//! Each object is swept from where it was at the last call, so fast projectiles
+//! can't pass through players between ticks. Hits are handled in time of impact order.
+void ServerArena::UpdateCollisions()
 {
-	GLib::ObjectType typeA = pObjectA->GetType();
-	GLib::ObjectType typeB = pObjectB->GetType();
+	mSpatialHash->Clear();
+	mSweeps->NextTick();
 
-	// Player - Projectile collision only.
-	if((pObjectB->GetType() == GLib::PLAYER && pObjectA->GetType() == GLib::PROJECTILE) || (pObjectB->GetType() == GLib::PROJECTILE && pObjectA->GetType() == GLib::PLAYER))
+	GLib::ObjectList* objects = mWorld->GetObjects();
+	for(auto iter = objects->begin(); iter != objects->end(); iter++)
 	{
-		Projectile* projectile = pObjectA->GetType() == GLib::PROJECTILE ? (Projectile*)pObjectA : (Projectile*)pObjectB;
-		Player* player = pObjectA->GetType() == GLib::PLAYER ? (Player*)pObjectA : (Player*)pObjectB;
-
-		if(projectile->GetOwner() == player->GetId())
-			return;
+		GLib::Object3D* object = (*iter);
+		CollisionLayer layer = COLLISION_LAYER_NONE;
+		int owner = object->GetId();
 
-		if(mServer->GetArenaState() != SHOPPING_STATE && !player->GetEliminated())
-		{
-			// Checks what skill the projectile is and uses the XML data to determine the skill attributes
-			// depending on the skill level.
-			projectile->HandlePlayerCollision(player, this, mServer->GetItemLoader());
-
-			// Add status effect if there is any.
-			StatusEffect* statusEffect = projectile->GetStatusEffect(mServer->GetItemLoader());
-			if(statusEffect != nullptr)
-				player->AddStatusEffect(statusEffect);
-
-			// Set hurt animation.
-			if(player->GetCurrentAnimation() != 7) // Death animation
-				player->SetAnimation(6, 0.4f);
-
-			// Add lifesteal life.
-			Player* owner = (Player*)mWorld->GetObjectById(projectile->GetOwner());
-			owner->SetCurrentHealth(owner->GetCurrentHealth() + owner->GetLifeSteal());
-
-			// Let the clients now about the changes immediately.
-			BroadcastWorld();
-
-			// Tell all clients about the collision.
-			RakNet::BitStream bitstream;
-			bitstream.Write((unsigned char)NMSG_PROJECTILE_PLAYER_COLLISION);
-			bitstream.Write(projectile->GetId());	// Projectile Id.
-			bitstream.Write(player->GetId());	// Player Id.
-			mServer->SendClientMessage(bitstream);
-
-			gConsole->AddLine("Projectile - Player collision (" + to_string(player->GetId()) + ", " + to_string(projectile->GetId())+ ")");
+		if(object->GetType() == GLib::PLAYER)
+			layer = COLLISION_LAYER_PLAYER;
+		else if(object->GetType() == GLib::PROJECTILE) {
+			layer = COLLISION_LAYER_PROJECTILE;
+			owner = ((Projectile*)object)->GetOwner();
 		}
+		else
+			continue;
 
-		// Remove the projectile.
-		projectile->Kill();
+		// New objects have no sweep.
+		XNA::AxisAlignedBox box = object->GetBoundingBox();
+		XMFLOAT3 start = box.Center;
+		mSweeps->GetLastCenter(object->GetId(), start);
+
+		mSpatialHash->Insert(object, box, start, layer, owner);
+		mSweeps->SetCenter(object->GetId(), box.Center);
 	}
-	else if(pObjectA->GetType() == GLib::PROJECTILE && pObjectB->GetType() == GLib::PROJECTILE)
-	{
-		Projectile* projectileA = (Projectile*)pObjectA;
-		Projectile* projectileB = (Projectile*)pObjectB;
 
-		if(projectileA->GetOwner() != projectileB->GetOwner())
+	// Broad and narrow-phase in parallel, each job handles a range of cells and keeps the pairs that hit.
+	int numCells = mSpatialHash->GetNumOccupiedCells();
+	int numJobs = (numCells + COLLISION_CELLS_PER_JOB - 1) / COLLISION_CELLS_PER_JOB;
+	if(mJobCollisionPairs.size() < numJobs)
+		mJobCollisionPairs.resize(numJobs);
+
+	mServer->GetJobs()->ParallelFor(numJobs, [&](int job) {
+		vector<CollisionPair>& pairs = mJobCollisionPairs[job];
+		pairs.clear();
+		mSpatialHash->FindCandidatePairs(job * COLLISION_CELLS_PER_JOB, min((job + 1) * COLLISION_CELLS_PER_JOB, numCells), pairs);
+
+		int numHits = 0;
+		for(int i = 0; i < pairs.size(); i++)
 		{
-			pObjectA->Kill();
-			pObjectB->Kill();
+			CollisionPair& pair = pairs[i];
+			if(mCollisionCallbacks[pair.layerA][pair.layerB] != nullptr && IntersectSweptSpheres(*pair.sphereA, *pair.sphereB, pair.timeOfImpact))
+				pairs[numHits++] = pair;
+		}
+
+		pairs.resize(numHits);
+	});
+
+	// Merge in job order so the result is the same as when run serially, then sort by time of impact.
+	mCollisionPairs.clear();
+	for(int i = 0; i < numJobs; i++)
+		mCollisionPairs.insert(mCollisionPairs.end(), mJobCollisionPairs[i].begin(), mJobCollisionPairs[i].end());
+
+	SortCollisionPairs();
+
+	// A projectile is removed by its first hit, later hits this tick are skipped.
+	mConsumedProjectiles.clear();
+	for(int i = 0; i < mCollisionPairs.size(); i++)
+	{
+		CollisionPair& pair = mCollisionPairs[i];
+		if(find(mConsumedProjectiles.begin(), mConsumedProjectiles.end(), pair.objectB) != mConsumedProjectiles.end())
+			continue;
 
-			// Tell all clients about the collision.
-			RakNet::BitStream bitstream;
-			bitstream.Write((unsigned char)NMSG_PROJECTILE_PROJECTILE_COLLISION);
-			mServer->SendClientMessage(bitstream);
+		if(pair.layerA == COLLISION_LAYER_PROJECTILE) {
+			if(find(mConsumedProjectiles.begin(), mConsumedProjectiles.end(), pair.objectA) != mConsumedProjectiles.end())
+				continue;
+			mConsumedProjectiles.push_back(pair.objectA);
 		}
+
+		mConsumedProjectiles.push_back(pair.objectB);
+		(this->*mCollisionCallbacks[pair.layerA][pair.layerB])(pair.objectA, pair.objectB);
+	}
+}
+
+//! Stable insertion sort on the time of impact. There are few hits per tick
+//! and unlike stable_sort it doesn't allocate a temporary buffer.
+void ServerArena::SortCollisionPairs()
+{
+	for(int i = 1; i < mCollisionPairs.size(); i++)
+	{
+		CollisionPair pair = mCollisionPairs[i];
+		int j = i - 1;
+		for(; j >= 0 && mCollisionPairs[j].timeOfImpact > pair.timeOfImpact; j--)
+			mCollisionPairs[j + 1] = mCollisionPairs[j];
+
+		mCollisionPairs[j + 1] = pair;
 	}
 }
 
@@ -327,11 +724,15 @@ void ServerArena::PlayerEliminated(Player* pKilled, Player* pEliminator)
 	if(pEliminator != nullptr)
 		pEliminator->SetGold(pEliminator->GetGold() + mServer->GetCvarValue(Cvars::GOLD_PER_KILL));
 
+	mServer->GetRoundHandler()->OnPlayerEliminated(pKilled);
+
 	// Tell the clients about the kill.
+	PlayerEliminatedMessage message;
+	message.killed = mServer->GetNameTable()->GetId(pKilled->GetId());
+	message.eliminator = pEliminator == nullptr ? INVALID_NAME_ID : mServer->GetNameTable()->GetId(pEliminator->GetId());
+
 	RakNet::BitStream bitstream;
-	bitstream.Write((unsigned char)NMSG_PLAYER_ELIMINATED);
-	bitstream.Write(pKilled->GetName().c_str());
-	bitstream.Write(pEliminator == nullptr ? "himself" : pEliminator->GetName().c_str());
+	message.Write(bitstream);
 	mServer->SendClientMessage(bitstream);
 
 	gConsole->AddLine(pKilled->GetName() + " was killed by " + (pEliminator == nullptr ? "himself" : pEliminator->GetName()));
@@ -344,12 +745,167 @@ void ServerArena::RemovePlayer(int id)
 	for(auto iter =  mPlayerList.begin(); iter != mPlayerList.end(); iter++)
 	{
 		if((*iter)->GetId() == id) {
+			Player* player = (*iter);
 			mPlayerList.erase(iter);
+
+			// Stop tracking the player.
+			mServer->GetRoundHandler()->OnPlayerRemoved(player);
+			mPlayersInLava.erase(remove(mPlayersInLava.begin(), mPlayersInLava.end(), player), mPlayersInLava.end());
+			mPlayerItems.erase(id);
+			mInputSequences.erase(id);
+			mAppliedInputs.erase(id);
+			mDamagedPlayers.erase(remove(mDamagedPlayers.begin(), mDamagedPlayers.end(), player), mDamagedPlayers.end());
+			mAfflictedPlayers.erase(remove(mAfflictedPlayers.begin(), mAfflictedPlayers.end(), player), mAfflictedPlayers.end());
 			break;
 		}
 	}
 }
 
+Player* ServerArena::GetPlayerByAdress(RakNet::SystemAddress adress)
+{
+	for(int i = 0; i < mPlayerList.size(); i++) {
+		if(mPlayerList[i]->GetSystemAdress() == adress)
+			return mPlayerList[i];
+	}
+
+	return nullptr;
+}
+
+//! Returns false for inputs that are older than the last one received, they are dropped.
+bool ServerArena::AcceptInput(Player* pPlayer, InputSequence sequence)
+{
+	auto iter = mInputSequences.find(pPlayer->GetId());
+	if(iter == mInputSequences.end()) {
+		mInputSequences[pPlayer->GetId()] = sequence;
+		return true;
+	}
+
+	if(!IsNewerSequence(sequence, (*iter).second))
+		return false;
+
+	(*iter).second = sequence;
+	return true;
+}
+
+//! The player jumped, sweeping from where it was would hit everything in between.
+void ServerArena::OnPlayerTeleported(Player* pPlayer)
+{
+	mSweeps->Forget(pPlayer->GetId());
+}
+
+//! Called when an input is in the simulation, world updates echo the last one.
+void ServerArena::AcknowledgeInput(int playerId, InputSequence sequence)
+{
+	auto iter = mAppliedInputs.find(playerId);
+	if(iter == mAppliedInputs.end())
+		mAppliedInputs[playerId] = sequence;
+	else if(IsNewerSequence(sequence, (*iter).second))
+		(*iter).second = sequence;
+}
+
+//! Collects the targets of a player until the next tick. A target that clears
+//! the queue replaces the ones added before it in the same tick.
+void ServerArena::QueueTarget(Player* pPlayer, InputSequence sequence, XMFLOAT3 target, bool clear)
+{
+	static const string RECEIVED_COUNTER = "warlock_target_inputs_total";
+	mServer->GetMetrics()->AddCount(RECEIVED_COUNTER);
+
+	PlayerMovement* movement = nullptr;
+	InputRange* inputs = nullptr;
+	for(int i = 0; i < mPendingMovement.players.count; i++) {
+		if(mPendingMovement.players.items[i].objectId == pPlayer->GetId()) {
+			movement = &mPendingMovement.players.items[i];
+			inputs = &mPendingInputs[i];
+		}
+	}
+
+	if(movement == nullptr)
+	{
+		PlayerMovement newMovement;
+		newMovement.objectId = pPlayer->GetId();
+		newMovement.clear = false;
+		if(!mPendingMovement.players.Add(newMovement))
+			return;
+
+		movement = &mPendingMovement.players.items[mPendingMovement.players.count - 1];
+		inputs = &mPendingInputs[mPendingMovement.players.count - 1];
+		inputs->first = sequence;
+	}
+
+	// Acknowledged once the targets are applied.
+	inputs->last = sequence;
+
+	if(clear) {
+		movement->clear = true;
+		movement->targets.count = 0;
+	}
+
+	movement->targets.Add(target);
+}
+
+//! Gives the players their collected targets and sends them to all clients in
+//! one message. When the server is overloaded it only happens every other tick.
+void ServerArena::ApplyMovement()
+{
+	static const string APPLIED_COUNTER = "warlock_target_inputs_applied_total";
+
+	if(mPendingMovement.players.count == 0)
+		return;
+
+	if(mServer->GetWatchdog()->IsDegraded(DEGRADE_TARGET_UPDATES) && mServer->GetSimulationTick() % 2 != 0)
+		return;
+
+	// Knocked back players ignore their targets, they are left out of the message.
+	int numApplied = 0;
+	int numTargets = 0;
+	for(int i = 0; i < mPendingMovement.players.count; i++)
+	{
+		PlayerMovement& movement = mPendingMovement.players.items[i];
+		Actor* actor = (Actor*)mWorld->GetObjectById(movement.objectId);
+		if(actor == nullptr)
+			continue;
+
+		// Ignored targets are acknowledged too, they never will be applied.
+		AcknowledgeInput(movement.objectId, mPendingInputs[i].last);
+		if(actor->IsKnockedBack())
+			continue;
+
+		for(int j = 0; j < movement.targets.count; j++)
+			actor->AddTarget(movement.targets.items[j], movement.clear && j == 0);
+
+		numTargets += movement.targets.count;
+		mPendingMovement.players.items[numApplied++] = movement;
+	}
+
+	mPendingMovement.players.count = numApplied;
+	mServer->GetMetrics()->AddCount(APPLIED_COUNTER, numTargets);
+
+	if(numApplied > 0) {
+		RakNet::BitStream* bitstream = mServer->GetBitStreamPool()->Acquire();
+		mPendingMovement.Write(*bitstream);
+		mServer->SendClientMessage(*bitstream);
+		mServer->GetBitStreamPool()->Release(bitstream);
+	}
+
+	mPendingMovement.players.count = 0;
+}
+
+//! The last input the simulation contains, and all before it. Targets still waiting
+//! for ApplyMovement(), like when the watchdog skips a tick, hold back the inputs
+//! after them that were applied already.
+InputSequence ServerArena::GetLastInputSequence(Player* pPlayer)
+{
+	auto iter = mAppliedInputs.find(pPlayer->GetId());
+	InputSequence applied = iter != mAppliedInputs.end() ? (*iter).second : 0;
+
+	for(int i = 0; i < mPendingMovement.players.count; i++) {
+		if(mPendingMovement.players.items[i].objectId == pPlayer->GetId() && !IsNewerSequence(mPendingInputs[i].first, applied))
+			applied = mPendingInputs[i].first - 1;
+	}
+
+	return applied;
+}
+
 string ServerArena::RemovePlayer(RakNet::SystemAddress adress)
 {
 	string name = "#NOVALUE";
@@ -371,6 +927,17 @@ GLib::World* ServerArena::GetWorld()
 	return mWorld;
 }
 
+float ServerArena::GetArenaRadius()
+{
+	return mArenaRadius;
+}
+
+//! Everything in the world that isn't a player is a projectile.
+int ServerArena::GetNumProjectiles()
+{
+	return mWorld->GetObjects()->size() - mPlayerList.size();
+}
+
 vector<Player*>* ServerArena::GetPlayerListPointer()
 {
 	return &mPlayerList;
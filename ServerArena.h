@@ -1,8 +1,12 @@
 #pragma once
 #include <string>
 #include <vector>
+#include <map>
 #include "BitStream.h"
 #include "BaseArena.h"
+#include "SpatialHash.h"
+#include "TimerWheel.h"
+#include "MatchCheckpoint.h"
 using namespace std;
 
 namespace GLib {
@@ -16,39 +20,90 @@ namespace GLib {
 class Server;
 class Player;
 class CollisionHandler;
+class SweepHistory;
+class SnapshotScheduler;
 
 class ServerArena : public BaseArena
 {
 public:
+	typedef void (ServerArena::*CollisionCallback)(GLib::Object3D* pObjectA, GLib::Object3D* pObjectB);
+
 	ServerArena(Server* pServer);
 	~ServerArena();
 
 	void Update(GLib::Input* pInput, float dt);
 	void Draw(GLib::Graphics* pGraphics);
 	void BroadcastWorld();
+	void BroadcastTick();
+	void SendSnapshot(SnapshotScheduler* pScheduler);
 	void StartGame();
 	void StartRound();
+	void ApplyLavaDamage();
+	void StartFlood();
+	void EndFlood();
+	void SetArenaRadius(float radius);
 
 	void OnObjectAdded(GLib::Object3D* pObject);
 	void OnObjectRemoved(GLib::Object3D* pObject);
-	void OnObjectCollision(GLib::Object3D* pObjectA, GLib::Object3D* pObjectB);
+	void FlushRemovedObjects();
+	void OnPlayerProjectileCollision(GLib::Object3D* pPlayer, GLib::Object3D* pProjectile);
+	void OnProjectileProjectileCollision(GLib::Object3D* pProjectileA, GLib::Object3D* pProjectileB);
+	void UpdateCollisions();
 
 	string	RemovePlayer(RakNet::SystemAddress adress);
 	void	RemovePlayer(int id);
 	void	PlayerEliminated(Player* pPlayer, Player* pEliminator);
 	void	RemoveStatusEffects();
+	void	OnPlayerDamaged(Player* pPlayer);
+	void	OnPlayerTeleported(Player* pPlayer);
+	void	OnPlayerItemAdded(Player* pPlayer, ItemName item, int level);
+	void	OnPlayerItemRemoved(Player* pPlayer, ItemName item, int level);
+	void	SetPlayerItems(Player* pPlayer, const CheckpointItemList& items);
+	void	GetPlayerItems(Player* pPlayer, CheckpointItemList& items);
+	Player*	GetPlayerByAdress(RakNet::SystemAddress adress);
+	bool	AcceptInput(Player* pPlayer, InputSequence sequence);
+	void	AcknowledgeInput(int playerId, InputSequence sequence);
+	void	QueueTarget(Player* pPlayer, InputSequence sequence, XMFLOAT3 target, bool clear);
+	void	ApplyMovement();
+	InputSequence GetLastInputSequence(Player* pPlayer);
 
 	GLib::World* GetWorld();
+	float GetArenaRadius();
+	int GetNumProjectiles();
 	vector<Player*>* GetPlayerListPointer();
 	bool IsGameStarted();
 private:
+	struct InputRange
+	{
+		InputSequence	first;
+		InputSequence	last;
+	};
+
+	void SortCollisionPairs();
+	void WriteSnapshotBegin(RakNet::BitStream& bitstream);
+	void WriteWorldUpdate(GLib::Object3D* pObject, RakNet::BitStream& bitstream);
+
 	Server*				mServer;
 	CollisionHandler*	mCollisionHandler;
-	float				mTickRate;
-	float				mTickCounter;
-	float				mDamageCounter;
+	SpatialHash*		mSpatialHash;
+	vector<CollisionPair> mCollisionPairs;
+	vector<vector<CollisionPair>> mJobCollisionPairs;
+	vector<GLib::Object3D*> mConsumedProjectiles;
+	SweepHistory*		mSweeps;
+	vector<Player*>		mPlayersInLava;
+	vector<Player*>		mDamagedPlayers;
+	vector<Player*>		mAfflictedPlayers;
+	map<int, vector<CheckpointItem>> mPlayerItems;	// The items of each player, for checkpoints.
+	map<int, InputSequence> mInputSequences;		// The last input received from each player.
+	map<int, InputSequence> mAppliedInputs;			// The last input applied for each player, echoed in world updates.
+	MovementUpdateMessage mPendingMovement;			// The targets added since the last tick.
+	InputRange			mPendingInputs[MAX_MESSAGE_PLAYERS];	// The inputs in each entry of mPendingMovement.
+	ObjectsRemovedMessage mRemovedObjects;			// The objects removed since the last flush.
+	CollisionCallback	mCollisionCallbacks[NUM_COLLISION_LAYERS][NUM_COLLISION_LAYERS];
+	TimerHandle			mLavaTimer;
+	TimerHandle			mFloodTimer;
 	bool				mGameStarted;
-	float				mFloodDelta;
+	bool				mFlooding;
 	float				mArenaFloodStartRadius;
 	float				mArenaRadius;
 };
\ No newline at end of file
@@ -8,6 +8,8 @@
 #include "RoundHandler.h"
 #include "NetworkMessages.h"
 #include "Console.h"
+#include "MessageSchema.h"
+#include <algorithm>
 
 ServerMessageHandler::ServerMessageHandler(Server* pServer)
 {
@@ -22,80 +24,64 @@ ServerMessageHandler::~ServerMessageHandler()
 void ServerMessageHandler::HandleNewConnection(RakNet::BitStream& bitstream, RakNet::SystemAddress adress)
 {
 	// Send connection successful message back.
-	// The message contains the players already connected.
-	GLib::World* world = mServer->GetWorld();
+	// The rest comes in the join message once the client sent its name.
 	RakNet::BitStream sendBitstream;
-	sendBitstream.Write((unsigned char)NMSG_CONNECTION_SUCCESS);
-	sendBitstream.Write(mServer->GetRoundHandler()->GetArenaState().state);
-	sendBitstream.Write(world->GetNumObjects(GLib::PLAYER));
-
-	GLib::ObjectList* objects = world->GetObjects();
-	for(auto iter = objects->begin(); iter != objects->end(); iter++)
-	{
-		GLib::Object3D* object = (*iter);
-		if(object->GetType() == GLib::PLAYER) {
-			sendBitstream.Write(object->GetName().c_str());
-			sendBitstream.Write(object->GetId());
-			sendBitstream.Write(object->GetPosition());
-		}
-	}
-
+	ConnectionSuccessMessage().Write(sendBitstream);
 	mServer->SendClientMessage(sendBitstream, false, adress);
 }
 
 void ServerMessageHandler::HandleConnectionLost(RakNet::BitStream& bitstream, RakNet::SystemAddress adress)
 {
-	RakNet::BitStream sendBitstream;
+	// The name id is released once the others know about the disconnect.
+	Player* player = mServer->GetArena()->GetPlayerByAdress(adress);
+
+	PlayerDisconnectedMessage message;
+	message.nameId = player != nullptr ? mServer->GetNameTable()->GetId(player->GetId()) : INVALID_NAME_ID;
 
 	string name = mServer->RemovePlayer(adress);
-	sendBitstream.Write((unsigned char)NMSG_PLAYER_DISCONNECTED);
-	sendBitstream.Write(name.c_str());	
 
 	OutputDebugString(string(name + " has disconnected!").c_str());
 
 	gConsole->AddLine(name + " has disconnected!");
 
 	// Tell the other clients about the disconnect.
+	RakNet::BitStream sendBitstream;
+	message.Write(sendBitstream);
 	mServer->SendClientMessage(sendBitstream);
+	mServer->ReleasePlayerName(message.nameId);
 }
 
-void ServerMessageHandler::HandleTargetAdded(RakNet::BitStream& bitstream)
+void ServerMessageHandler::HandleTargetAdded(RakNet::BitStream& bitstream, RakNet::SystemAddress adress)
 {
-	char name[244];
-	unsigned char id;
-	float x, y, z;
-	bool clear;
-	bitstream.Read(name);
-	bitstream.Read(id);
-	bitstream.Read(x);
-	bitstream.Read(y);
-	bitstream.Read(z);
-	bitstream.Read(clear);
-
-	GLib::ObjectList* objects = mServer->GetWorld()->GetObjects();
-	for(auto iter = objects->begin(); iter != objects->end(); iter++)
-	{
-		Actor* actor = (Actor*)(*iter);
-		if(actor->GetId() == id && !actor->IsKnockedBack()) {
-			actor->AddTarget(XMFLOAT3(x, y, z), clear);
-
-			// Send the TARGET_ADDED to all clients.
-			mServer->SendClientMessage(bitstream);
-
-			char buffer[64];
-			sprintf(buffer, "(%.1f, %.1f, %.1f)", x, y, z);
-			gConsole->AddLine("[" + actor->GetName() + "] ADD_TARGET " + buffer);
-
-			break;
-		}
+	TargetAddedMessage message;
+	if(!message.Read(bitstream))
+		return;
+
+	// Clients can only move their own player.
+	Player* sender = mServer->GetArena()->GetPlayerByAdress(adress);
+	if(sender == nullptr || sender->GetId() != message.objectId || !mServer->GetArena()->AcceptInput(sender, message.sequence))
+		return;
+
+	// Applied, acknowledged and sent to the clients at the start of the next tick.
+	mServer->GetArena()->QueueTarget(sender, message.sequence, XMFLOAT3(message.x, message.y, message.z), message.clear);
+
+	if(gConsole->IsVerbose()) {
+		char buffer[320];
+		sprintf(buffer, "[%s] ADD_TARGET (%.1f, %.1f, %.1f)", sender->GetName().c_str(), message.x, message.y, message.z);
+		gConsole->AddLine(buffer);
 	}
 }
 
 void ServerMessageHandler::HandleConnectionData(RakNet::BitStream& bitstream, RakNet::SystemAddress adress)
 {
-	char buffer[244];
-	bitstream.Read(buffer);
-	string name = buffer;
+	ConnectionDataMessage message;
+	if(!message.Read(bitstream))
+		return;
+
+	// Longer names are cut instead of refusing the player.
+	NameString shortName;
+	shortName.Set(message.name.text);
+	string name = shortName.text;
 
 	// Add a new player to the World.
 	Player* player = new Player();
@@ -106,165 +92,244 @@ void ServerMessageHandler::HandleConnectionData(RakNet::BitStream& bitstream, Ra
 	player->SetGold(mServer->GetCvarValue(Cvars::START_GOLD));
 	mServer->GetWorld()->AddObject(player);
 
-	gConsole->AddLine(name + " has connected!");
+	// From here on messages refer to the player with its name id.
+	NameId nameId = mServer->InternPlayerName(name, player->GetId());
 
-	// [TODO] Add model name and other attributes.
-	RakNet::BitStream sendBitstream;
-	sendBitstream.Write((unsigned char)NMSG_ADD_PLAYER);
-	sendBitstream.Write(name.c_str());
-	sendBitstream.Write(player->GetId());
-	sendBitstream.Write(mServer->GetCvarValue(Cvars::START_GOLD));
+	gConsole->AddLine(name + " has connected!");
 
 	// Set starting score.
 	mServer->SetScore(name, 0);
 
-	// Send the message to all clients. ("PlayerName has connected to the game").
-	mServer->SendClientMessage(sendBitstream);
+	// The joining client gets everything in one message.
+	SendJoinBootstrap(player, nameId, adress);
 
-	// Send cvar values.
-	auto cvarMap = mServer->GetCvars().CvarMap;
-	for(auto iter = cvarMap.begin(); iter != cvarMap.end(); iter++) {
-		string cvar = (*iter).first;
-		int value = (*iter).second;
-		SendCvarValue(adress, cvar, value, true);
-	}
+	// [TODO] Add model name and other attributes.
+	AddPlayerMessage addPlayer;
+	addPlayer.name = shortName;
+	addPlayer.objectId = player->GetId();
+	addPlayer.gold = mServer->GetCvarValue(Cvars::START_GOLD);
+	addPlayer.nameId = nameId;
+
+	// Send the message to the other clients. ("PlayerName has connected to the game").
+	RakNet::BitStream sendBitstream;
+	addPlayer.Write(sendBitstream);
+	mServer->SendClientMessage(sendBitstream, true, adress);
 
 	// [NOTE][TEMP] Start the round.
 	//mServer->GetRoundHandler()->StartRound();
 }
 
-void ServerMessageHandler::HandleNamesRequest(RakNet::BitStream& bitstream, RakNet::SystemAddress adress)
+//! Sends the joining player its ids, the state of the match, all players and all cvars.
+void ServerMessageHandler::SendJoinBootstrap(Player* pPlayer, NameId nameId, RakNet::SystemAddress adress)
 {
-	// Send all client names back to the requested client.
-	GLib::World* world = mServer->GetWorld();
+	JoinBootstrapMessage message;
+	message.objectId = pPlayer->GetId();
+	message.nameId = nameId;
+	message.state = mServer->GetRoundHandler()->GetArenaState().state;
+	message.stateElapsed = mServer->GetRoundHandler()->GetArenaState().elapsed;
+	message.completedRounds = mServer->GetRoundHandler()->GetCompletedRounds();
+	message.arenaRadius = mServer->GetArena()->GetArenaRadius();
+
+	// The roster, including the joining player.
+	GLib::ObjectList* objects = mServer->GetWorld()->GetObjects();
+	for(auto iter = objects->begin(); iter != objects->end(); iter++)
+	{
+		GLib::Object3D* object = (*iter);
+		if(object->GetType() == GLib::PLAYER) {
+			PlayerInfo info;
+			info.name.Set(object->GetName());
+			info.objectId = object->GetId();
+			info.position = object->GetPosition();
+			info.nameId = mServer->GetNameTable()->GetId(object->GetId());
+			message.players.Add(info);
+		}
+	}
+
+	// The cvars that don't fit follow as silent cvar changes.
+	auto& cvarMap = mServer->GetCvars().CvarMap;
+	auto iter = cvarMap.begin();
+	for(; iter != cvarMap.end(); iter++) 
+	{
+		CvarValue cvar;
+		cvar.cvar.Set((*iter).first);
+		cvar.value = (*iter).second;
+
+		if(!message.cvars.Add(cvar))
+			break;
+	}
+
 	RakNet::BitStream sendBitstream;
-	sendBitstream.Write((unsigned char)NSMG_CONNECTED_CLIENTS);
-	sendBitstream.Write(world->GetNumObjects(GLib::PLAYER));
+	message.Write(sendBitstream);
+	mServer->SendClientMessage(sendBitstream, false, adress);
 
-	vector<string> clients;
-	GLib::ObjectList* objects = world->GetObjects();
+	for(; iter != cvarMap.end(); iter++)
+	{
+		CvarChangeMessage change;
+		change.cvar.Set((*iter).first);
+		change.value = (*iter).second;
+		change.show = 0;
+
+		sendBitstream.Reset();
+		change.Write(sendBitstream);
+		mServer->SendClientMessage(sendBitstream, false, adress);
+	}
+}
+
+void ServerMessageHandler::HandleNamesRequest(RakNet::BitStream& bitstream, RakNet::SystemAddress adress)
+{
+	// Send all client name ids back to the requested client.
+	// The client has the names from when it joined.
+	ConnectedClientsMessage message;
+	GLib::ObjectList* objects = mServer->GetWorld()->GetObjects();
 	for(auto iter = objects->begin(); iter != objects->end(); iter++)
 	{
 		GLib::Object3D* object = (*iter);
 		if(object->GetType() == GLib::PLAYER)
-			sendBitstream.Write(object->GetName().c_str());
+			message.players.Add(mServer->GetNameTable()->GetId(object->GetId()));
 	}
 
+	RakNet::BitStream sendBitstream;
+	message.Write(sendBitstream);
 	mServer->SendClientMessage(sendBitstream, false, adress);
 }
 
 void ServerMessageHandler::HandleCvarListRequest(RakNet::BitStream& bitstream, RakNet::SystemAddress adress)
 {
-	// Send all client names back to the requested client.
-	RakNet::BitStream sendBitstream;
-	sendBitstream.Write((unsigned char)NMSG_REQUEST_CVAR_LIST);
-	sendBitstream.Write(mServer->GetCvarValue(Cvars::START_GOLD));
-	sendBitstream.Write(mServer->GetCvarValue(Cvars::SHOP_TIME));
-	sendBitstream.Write(mServer->GetCvarValue(Cvars::ROUND_TIME));
-	sendBitstream.Write(mServer->GetCvarValue(Cvars::NUM_ROUNDS));
-	sendBitstream.Write(mServer->GetCvarValue(Cvars::GOLD_PER_KILL));
-	sendBitstream.Write(mServer->GetCvarValue(Cvars::GOLD_PER_WIN));
-	sendBitstream.Write(mServer->GetCvarValue(Cvars::GOLD_PER_ROUND));
-	sendBitstream.Write(mServer->GetCvarValue(Cvars::LAVA_DMG));
-	sendBitstream.Write(mServer->GetCvarValue(Cvars::PROJECTILE_IMPULSE));
-	sendBitstream.Write(mServer->GetCvarValue(Cvars::ARENA_RADIUS));
-	sendBitstream.Write(mServer->GetCvarValue(Cvars::FLOOD_INTERVAL));
-	sendBitstream.Write(mServer->GetCvarValue(Cvars::FLOOD_SIZE));
-	sendBitstream.Write(mServer->GetCvarValue(Cvars::CHEATS));
+	// Send all the cvars back to the requested client.
+	CvarListMessage message;
+	message.startGold = mServer->GetCvarValue(Cvars::START_GOLD);
+	message.shopTime = mServer->GetCvarValue(Cvars::SHOP_TIME);
+	message.roundTime = mServer->GetCvarValue(Cvars::ROUND_TIME);
+	message.numRounds = mServer->GetCvarValue(Cvars::NUM_ROUNDS);
+	message.goldPerKill = mServer->GetCvarValue(Cvars::GOLD_PER_KILL);
+	message.goldPerWin = mServer->GetCvarValue(Cvars::GOLD_PER_WIN);
+	message.goldPerRound = mServer->GetCvarValue(Cvars::GOLD_PER_ROUND);
+	message.lavaDamage = mServer->GetCvarValue(Cvars::LAVA_DMG);
+	message.projectileImpulse = mServer->GetCvarValue(Cvars::PROJECTILE_IMPULSE);
+	message.arenaRadius = mServer->GetCvarValue(Cvars::ARENA_RADIUS);
+	message.floodInterval = mServer->GetCvarValue(Cvars::FLOOD_INTERVAL);
+	message.floodSize = mServer->GetCvarValue(Cvars::FLOOD_SIZE);
+	message.cheats = mServer->GetCvarValue(Cvars::CHEATS);
 
 	gConsole->AddLine("Sending cvar list...");
 
+	RakNet::BitStream sendBitstream;
+	message.Write(sendBitstream);
 	mServer->SendClientMessage(sendBitstream, false, adress);
 }
 
-void ServerMessageHandler::HandleSkillCasted(RakNet::BitStream& bitstream)
+void ServerMessageHandler::HandleSkillCasted(RakNet::BitStream& bitstream, RakNet::SystemAddress adress)
 {
-	unsigned char skillCasted;
-	bitstream.Read(skillCasted);
-	mServer->GetSkillInterpreter()->Interpret(mServer, (MessageId)skillCasted, bitstream);
+	SkillCastRequest request;
+	if(!request.Read(bitstream))
+		return;
+
+	// Clients can only cast with their own player.
+	Player* sender = mServer->GetArena()->GetPlayerByAdress(adress);
+	if(sender == nullptr || sender->GetId() != request.owner || !mServer->GetArena()->AcceptInput(sender, request.sequence))
+		return;
+
+	// Spawned and acknowledged at the start of the next tick. A skill that
+	// can't be cast never will be, so it's acknowledged right away.
+	if(!mServer->GetSkillInterpreter()->QueueCast(request))
+		mServer->GetArena()->AcknowledgeInput(sender->GetId(), request.sequence);
 }
 
 void ServerMessageHandler::HandleItemAdded(RakNet::BitStream& bitstream, RakNet::SystemAddress adress)
 {
-	ItemName name;
-	int playerId, level;
-	bitstream.Read(playerId);
-	bitstream.Read(name);
-	bitstream.Read(level);
+	ItemAddedMessage message;
+	if(!message.Read(bitstream))
+		return;
+
+	Player* player = (Player*)mServer->GetWorld()->GetObjectById(message.playerId);
+	if(player == nullptr)
+		return;
 
-	Player* player = (Player*)mServer->GetWorld()->GetObjectById(playerId);
-	player->AddItem(mServer->GetItemLoader(), ItemKey(name, level));
+	player->AddItem(mServer->GetItemLoader(), ItemKey(message.item, message.level));
+	mServer->GetArena()->OnPlayerItemAdded(player, message.item, message.level);
 
 	// Send to all client except to the one it came from.
 	RakNet::BitStream sendBitstream;
-	sendBitstream.Write((unsigned char)NMSG_ITEM_ADDED);
-	sendBitstream.Write(playerId);
-	sendBitstream.Write(name);
-	sendBitstream.Write(level);
-
+	message.Write(sendBitstream);
 	mServer->SendClientMessage(sendBitstream, true, adress);
 
 	char buffer[32];
-	sprintf(buffer, "(%i, %i)", name, level);
+	sprintf(buffer, "(%i, %i)", message.item, message.level);
 	gConsole->AddLine("[" + player->GetName() + "] ITEM_ADDED " + buffer);
 }
 
 void ServerMessageHandler::HandleItemRemoved(RakNet::BitStream& bitstream, RakNet::SystemAddress adress)
 {
-	ItemName name;
-	int playerId, level;
-	bitstream.Read(playerId);
-	bitstream.Read(name);
-	bitstream.Read(level);
+	ItemRemovedMessage message;
+	if(!message.Read(bitstream))
+		return;
 
-	Player* player = (Player*)mServer->GetWorld()->GetObjectById(playerId);
-	player->RemoveItem(mServer->GetItemLoader()->GetItem(ItemKey(name, level)));
+	Player* player = (Player*)mServer->GetWorld()->GetObjectById(message.playerId);
+	if(player == nullptr)
+		return;
+
+	player->RemoveItem(mServer->GetItemLoader()->GetItem(ItemKey(message.item, message.level)));
+	mServer->GetArena()->OnPlayerItemRemoved(player, message.item, message.level);
 
 	// [TODO] REMOVE SKILLS!! [TODO]
 
 	// Send to all client except to the one it came from.
 	RakNet::BitStream sendBitstream;
-	sendBitstream.Write((unsigned char)NMSG_ITEM_REMOVED);
-	sendBitstream.Write(playerId);
-	sendBitstream.Write(name);
-	sendBitstream.Write(level);
-
+	message.Write(sendBitstream);
 	mServer->SendClientMessage(sendBitstream, true, adress);
 
 	char buffer[32];
-	sprintf(buffer, "(%i, %i)", name, level);
+	sprintf(buffer, "(%i, %i)", message.item, message.level);
 	gConsole->AddLine("[" + player->GetName() + "] ITEM_REMOVED " + buffer);
 }
 
 void ServerMessageHandler::HandleGoldChange(RakNet::BitStream& bitstream, RakNet::SystemAddress adress)
 {
-	int id, gold;
-	bitstream.Read(id);
-	bitstream.Read(gold);
+	GoldChangeMessage message;
+	if(!message.Read(bitstream))
+		return;
 
-	Player* player = ((Player*)mServer->GetWorld()->GetObjectById(id));
-	player->SetGold(gold);
+	Player* player = ((Player*)mServer->GetWorld()->GetObjectById(message.playerId));
+	if(player == nullptr)
+		return;
 
-	gConsole->AddLine("[" + player->GetName() + "] GOLD_CHANGE " + to_string(gold));
+	player->SetGold(message.gold);
+
+	gConsole->AddLine("[" + player->GetName() + "] GOLD_CHANGE " + to_string(message.gold));
 }
 
-void ServerMessageHandler::HandleChatMessage(RakNet::BitStream& bitstream, RakNet::SystemAddress adress)
+void ServerMessageHandler::HandleChatMessage(RakNet::BitStream& bitstream, RakNet::Packet* pPacket)
 {
-	// Send the message to all clients.
-	mServer->SendClientMessage(bitstream);
+	RakNet::SystemAddress adress = pPacket->systemAddress;
+
+	ChatMessage chat;
+	if(!chat.Read(bitstream))
+		return;
+
+	NameId from = chat.from;
+	const char* message = chat.message.text;
 
-	// CVAR command?
-	char from[32];
-	char message[256];
+	// Only relay messages sent in the senders own name.
+	Player* sender = mServer->GetArena()->GetPlayerByAdress(adress);
+	if(sender == nullptr || mServer->GetNameTable()->GetId(sender->GetId()) != from)
+		return;
 
-	bitstream.Read(from);
-	bitstream.Read(message);
+	// Send the message to all clients. Chat can wait when the server is overloaded,
+	// commands can't since their answers must arrive after them.
+	if(message[0] == '-')
+		mServer->RelayPacket(pPacket);
+	else
+		mServer->RelayDeferrablePacket(pPacket);
 
-	gConsole->AddLine("<" + string(from) + ">: " + string(message).substr(0, string(message).size() - 1));
+	gConsole->AddLine("<" + mServer->GetNameTable()->GetName(from) + ">: " + string(message).substr(0, string(message).size() - 1));
+
+	// CVAR command? The message ends with a line break.
+	if(strlen(message) < 2)
+		return;
 
 	string msg = string(message).substr(0, string(message).size() - 2);
 	vector<string> elems = GLib::SplitString(msg, ' ');
-	if(mServer->IsCvarCommand(elems[0]))
+	if(!elems.empty() && mServer->IsCvarCommand(elems[0]))
 	{
 		if(mServer->IsHost(from))
 		{
@@ -276,7 +341,7 @@ void ServerMessageHandler::HandleChatMessage(RakNet::BitStream& bitstream, RakNe
 
 					// Send cvar change message.
 					mServer->SetCvarValue(elems[0], value);
-					SendCvarValue(adress, elems[0], value, true);
+					SendCvarValue(elems[0], value, true);
 
 					gConsole->AddLine(elems[0] + " changed to " + to_string(value));
 				}
@@ -320,30 +385,53 @@ void ServerMessageHandler::HandleChatMessage(RakNet::BitStream& bitstream, RakNe
 	}
 }
 
+//! Answered right away so the time spent on the server is as small as possible.
+void ServerMessageHandler::HandleTimeSyncRequest(RakNet::BitStream& bitstream, RakNet::SystemAddress adress)
+{
+	TimeSyncRequest request;
+	if(!request.Read(bitstream))
+		return;
+
+	TimeSyncResponse response;
+	response.clientTime = request.clientTime;
+	response.serverTime = mServer->GetServerTime();
+	response.serverTick = mServer->GetSimulationTick();
+	response.averagePing = (unsigned short)max(mServer->GetRaknetPeer()->GetAveragePing(adress), 0);
+
+	RakNet::BitStream sendBitstream;
+	response.Write(sendBitstream);
+	mServer->SendImmediateMessage(sendBitstream, adress);
+}
+
 void ServerMessageHandler::HandleRematchRequest(RakNet::BitStream& bitstream)
 {
-	// Remove scores and reset the round handler.
-	mServer->ResetScores();
+	// There is no match to restart before the game has started.
+	if(mServer->IsInLobby())
+		return;
+
+	// The scores, gold, items and round count come back from the start of the
+	// match, the game itself is still running so only a new round is needed.
+	mServer->RestoreCheckpoint(mServer->GetMatchStartCheckpoint());
 	mServer->GetRoundHandler()->StartRound();
-	mServer->GetRoundHandler()->Rematch();
-	mServer->GetArena()->StartGame();
-	//mServer->GetItemLoader()->ReloadItems();
 
 	// Inform all clients about the rematch.
 	RakNet::BitStream sendBitstream;
-	sendBitstream.Write((unsigned char)NMSG_PERFORM_REMATCH);
+	PerformRematchMessage().Write(sendBitstream);
 	mServer->SendClientMessage(sendBitstream);
 
 	gConsole->AddLine("Rematch!");
 }
 
-void ServerMessageHandler::SendCvarValue(RakNet::SystemAddress adress, string cvar, int value, bool show)
+//! Sent to all clients, every client needs the same cvars.
+void ServerMessageHandler::SendCvarValue(string cvar, int value, bool show)
 {
 	// Send cvar change message.
+	CvarChangeMessage message;
+	message.cvar.Set(cvar);
+	message.value = value;
+	message.show = show ? 1 : 0; // Show change in chat or not.
+
 	RakNet::BitStream bitstream;
-	bitstream.Write((unsigned char)NMSG_CVAR_CHANGE);
-	bitstream.Write(cvar.c_str());
-	bitstream.Write(value);
-	bitstream.Write(show ? 1 : 0); // Show change in chat or not.
+	message.Write(bitstream);
 	mServer->SendClientMessage(bitstream);
 }
\ No newline at end of file
@@ -1,10 +1,16 @@
 #pragma once
 #include "BitStream.h"
+#include "NameTable.h"
 #include <string>
 
 using namespace std;
 
 class Server;
+class Player;
+
+namespace RakNet {
+	struct Packet;
+}
 
 class ServerMessageHandler
 {
@@ -23,12 +29,14 @@ public:
 	void HandleItemAdded(RakNet::BitStream& bitstream, RakNet::SystemAddress adress);
 	void HandleItemRemoved(RakNet::BitStream& bitstream, RakNet::SystemAddress adress);
 	void HandleGoldChange(RakNet::BitStream& bitstream, RakNet::SystemAddress adress);
-	void HandleTargetAdded(RakNet::BitStream& bitstream);
-	void HandleSkillCasted(RakNet::BitStream& bitstream);
+	void HandleTargetAdded(RakNet::BitStream& bitstream, RakNet::SystemAddress adress);
+	void HandleSkillCasted(RakNet::BitStream& bitstream, RakNet::SystemAddress adress);
 	void HandleRematchRequest(RakNet::BitStream& bitstream);
-	void HandleChatMessage(RakNet::BitStream& bitstream, RakNet::SystemAddress adress);
+	void HandleTimeSyncRequest(RakNet::BitStream& bitstream, RakNet::SystemAddress adress);
+	void HandleChatMessage(RakNet::BitStream& bitstream, RakNet::Packet* pPacket);
 
-	void SendCvarValue(RakNet::SystemAddress adress, string cvar, int value, bool show);
+	void SendJoinBootstrap(Player* pPlayer, NameId nameId, RakNet::SystemAddress adress);
+	void SendCvarValue(string cvar, int value, bool show);
 private:
 	Server* mServer;
 };
\ No newline at end of file
@@ -0,0 +1,15 @@
+#pragma once
+#include "MessageIdentifiers.h"
+
+//! Message ids added by the server, NetworkMessages.h on the client side needs
+//! the same ids. They start well above the ids in NetworkMessages.h.
+enum ServerMessageId
+{
+	NMSG_JOIN_BOOTSTRAP = 220,	// Everything a joining client needs, sent only to it.
+	NMSG_TIME_SYNC_REQUEST,		// Client asks for the server time.
+	NMSG_TIME_SYNC_RESPONSE,
+	NMSG_SNAPSHOT_BEGIN,		// Stamps the world updates that follow.
+	NMSG_MOVEMENT_UPDATE,		// The targets all players added in a tick.
+	NMSG_SKILL_CAST_BATCH,		// The casts spawned in a tick.
+	NMSG_OBJECTS_REMOVED,		// The objects removed in a tick.
+};
\ No newline at end of file
@@ -11,89 +11,162 @@
 #include "GrapplingHook.h"
 #include "Player.h"
 #include "Console.h"
+#include "BitStreamPool.h"
+#include "ServerArena.h"
+#include "ObjectPool.h"
 
-ServerSkillInterpreter::ServerSkillInterpreter()
+// Projectiles of each type allocated up front, casts don't touch the heap until they run out.
+static const int	PROJECTILE_POOL_SIZE = 64;
+
+static Projectile* SpawnFireball(GLib::World* pWorld, Player* pPlayer, const XMFLOAT3& start, const XMFLOAT3& end, const XMFLOAT3& dir)
 {
+	return new Pooled<FireProjectile>(pPlayer->GetId(), start, dir);
+}
 
+static Projectile* SpawnFrostNova(GLib::World* pWorld, Player* pPlayer, const XMFLOAT3& start, const XMFLOAT3& end, const XMFLOAT3& dir)
+{
+	return new Pooled<FrostProjectile>(pPlayer->GetId(), start);
 }
 
-ServerSkillInterpreter::~ServerSkillInterpreter()
+static Projectile* SpawnHook(GLib::World* pWorld, Player* pPlayer, const XMFLOAT3& start, const XMFLOAT3& end, const XMFLOAT3& dir)
 {
+	return new Pooled<HookProjectile>(pPlayer->GetId(), start, dir);
+}
 
+static Projectile* SpawnTeleport(GLib::World* pWorld, Player* pPlayer, const XMFLOAT3& start, const XMFLOAT3& end, const XMFLOAT3& dir)
+{
+	Teleport teleport;
+	teleport.Cast(pWorld, pPlayer, start, end);
+	return nullptr;
 }
 
-void ServerSkillInterpreter::Interpret(Server* pServer, MessageId id, RakNet::BitStream& bitstream)
+static Projectile* SpawnMeteor(GLib::World* pWorld, Player* pPlayer, const XMFLOAT3& start, const XMFLOAT3& end, const XMFLOAT3& dir)
 {
-	GLib::World* world = pServer->GetWorld();
+	return new Pooled<MeteorProjectile>(pPlayer->GetId(), end);
+}
 
-	XMFLOAT3 start, end, dir;
-	int owner, skillLevel;
-	ItemName skillType;
+static Projectile* SpawnVenom(GLib::World* pWorld, Player* pPlayer, const XMFLOAT3& start, const XMFLOAT3& end, const XMFLOAT3& dir)
+{
+	return new Pooled<VenomProjectile>(pPlayer->GetId(), start, dir);
+}
 
-	bitstream.Read(owner);
-	bitstream.Read(skillType);
-	bitstream.Read(skillLevel);
-	bitstream.Read(start);
-	bitstream.Read(end);
+static Projectile* SpawnGrapplingHook(GLib::World* pWorld, Player* pPlayer, const XMFLOAT3& start, const XMFLOAT3& end, const XMFLOAT3& dir)
+{
+	return new Pooled<GrapplingHook>(pPlayer->GetId(), start, dir);
+}
 
-	XMStoreFloat3(&dir, XMVector3Normalize(XMLoadFloat3(&end) - XMLoadFloat3(&start)));
+ServerSkillInterpreter::ServerSkillInterpreter()
+{
+	for(int i = 0; i < 256; i++)
+		mSpawners[i] = nullptr;
+
+	mSpawners[SKILL_FIREBALL] = &SpawnFireball;
+	mSpawners[SKILL_FROSTNOVA] = &SpawnFrostNova;
+	mSpawners[SKILL_HOOK] = &SpawnHook;
+	mSpawners[SKILL_TELEPORT] = &SpawnTeleport;
+	mSpawners[SKILL_METEOR] = &SpawnMeteor;
+	mSpawners[SKILL_VENOM] = &SpawnVenom;
+	mSpawners[SKILL_GRAPPLING_HOOK] = &SpawnGrapplingHook;
+
+	Pooled<FireProjectile>::Reserve(PROJECTILE_POOL_SIZE);
+	Pooled<FrostProjectile>::Reserve(PROJECTILE_POOL_SIZE);
+	Pooled<HookProjectile>::Reserve(PROJECTILE_POOL_SIZE);
+	Pooled<MeteorProjectile>::Reserve(PROJECTILE_POOL_SIZE);
+	Pooled<VenomProjectile>::Reserve(PROJECTILE_POOL_SIZE);
+	Pooled<GrapplingHook>::Reserve(PROJECTILE_POOL_SIZE);
+}
 
-	Player* player = (Player*)world->GetObjectById(owner);
-	Projectile* projectile = nullptr;
+ServerSkillInterpreter::~ServerSkillInterpreter()
+{
 
-	// Set player rotation facing dir target.
-	player->SetRotation(XMFLOAT3(0, atan2f(-dir.x, -dir.z), 0));
+}
 
-	// Set attack animation.
-	player->SetAnimation(5, 0.7f);
+//! The sender has been checked already, only the skill is left to validate.
+bool ServerSkillInterpreter::QueueCast(const SkillCastRequest& request)
+{
+	if(mSpawners[request.skill] == nullptr)
+		return false;
 
-	if(id == SKILL_FIREBALL)
-		projectile = new FireProjectile(owner, start, dir);
-	else if(id == SKILL_FROSTNOVA)
-		projectile = new FrostProjectile(owner, start);
-	else if(id == SKILL_HOOK)
-		projectile = new HookProjectile(owner, start, dir);
-	else if(id == SKILL_TELEPORT) 
-	{
-		// This is really ugly, should be handled by Teleport itself...
-		Teleport teleport;
-		teleport.Cast(world, (Player*)player, start, end);
-	}
-	else if(id == SKILL_METEOR)
-	{
-		projectile = new MeteorProjectile(owner, end);
-	}
-	else if(id == SKILL_VENOM) 
-	{
-		projectile = new VenomProjectile(owner, start, dir);
-	}
-	else if(id == SKILL_GRAPPLING_HOOK) 
-	{
-		projectile = new GrapplingHook(owner, start, dir);
-	}
+	mQueuedCasts.push_back(request);
+	return true;
+}
 
-	RakNet::BitStream sendBitstream;
-	sendBitstream.Write((unsigned char)NMSG_SKILL_CAST);
-	sendBitstream.Write((unsigned char)id);
-	sendBitstream.Write(owner);
-	sendBitstream.Write(skillType);
-	sendBitstream.Write(skillLevel);
-	sendBitstream.Write(start);
-	sendBitstream.Write(end);
+//! Spawns the casts queued since the last tick and tells the clients about them in one message.
+void ServerSkillInterpreter::SpawnQueued(Server* pServer)
+{
+	if(mQueuedCasts.empty())
+		return;
 
-	if(id == SKILL_FIREBALL || id == SKILL_FROSTNOVA || id == SKILL_METEOR || id == SKILL_HOOK || id == SKILL_VENOM || id == SKILL_GRAPPLING_HOOK)
-	{
-		world->AddObject(projectile);
-		projectile->SetSkillLevel(skillLevel);
-		projectile->SetSkillType(skillType);
+	GLib::World* world = pServer->GetWorld();
+	mBatch.casts.count = 0;
 
-		projectile->SetPosition(projectile->GetPosition() + XMFLOAT3(0, 2, 0));
-		sendBitstream.Write(projectile->GetId());
+	for(int i = 0; i < mQueuedCasts.size(); i++)
+	{
+		const SkillCastRequest& request = mQueuedCasts[i];
+
+		// The player can have left since the cast arrived.
+		Player* player = (Player*)world->GetObjectById(request.owner);
+		if(player == nullptr)
+			continue;
+
+		XMFLOAT3 start = request.start, end = request.end, dir;
+		XMStoreFloat3(&dir, XMVector3Normalize(XMLoadFloat3(&end) - XMLoadFloat3(&start)));
+
+		// Set player rotation facing dir target.
+		player->SetRotation(XMFLOAT3(0, atan2f(-dir.x, -dir.z), 0));
+
+		// Set attack animation.
+		player->SetAnimation(5, 0.7f);
+
+		SkillCastEntry cast;
+		cast.skill = request.skill;
+		cast.owner = request.owner;
+		cast.skillType = request.skillType;
+		cast.skillLevel = request.skillLevel;
+		cast.start = start;
+		cast.end = end;
+		cast.projectileId = -1;
+
+		Projectile* projectile = mSpawners[request.skill](world, player, start, end, dir);
+		if(projectile != nullptr)
+		{
+			world->AddObject(projectile);
+			projectile->SetSkillLevel(request.skillLevel);
+			projectile->SetSkillType(request.skillType);
+
+			projectile->SetPosition(projectile->GetPosition() + XMFLOAT3(0, 2, 0));
+			cast.projectileId = projectile->GetId();
+		}
+		else if(request.skill == SKILL_TELEPORT)
+			pServer->GetArena()->OnPlayerTeleported(player);
+
+		// The cast is in the simulation now, world updates can acknowledge it.
+		pServer->GetArena()->AcknowledgeInput(request.owner, request.sequence);
+
+		if(gConsole->IsVerbose()) {
+			char buffer[64];
+			sprintf(buffer, "[%s] CAST_SKILL (%i)", player->GetName().c_str(), request.skillType);
+			gConsole->AddLine(buffer);
+		}
+
+		// Send a full message and start on the next.
+		if(!mBatch.casts.Add(cast)) {
+			SendCasts(pServer, mBatch);
+			mBatch.casts.count = 0;
+			mBatch.casts.Add(cast);
+		}
 	}
-	char buffer[10];
-	sprintf(buffer, "(%i)", skillType);
-	gConsole->AddLine("[" + player->GetName() + "] CAST_SKILL " + buffer);
 
-	// Send it to all the clients.
-	pServer->SendClientMessage(sendBitstream);
+	if(mBatch.casts.count > 0)
+		SendCasts(pServer, mBatch);
+
+	mQueuedCasts.clear();
+}
+
+void ServerSkillInterpreter::SendCasts(Server* pServer, const SkillCastBatchMessage& message)
+{
+	RakNet::BitStream* bitstream = pServer->GetBitStreamPool()->Acquire();
+	message.Write(*bitstream);
+	pServer->SendClientMessage(*bitstream);
+	pServer->GetBitStreamPool()->Release(bitstream);
 }
\ No newline at end of file
@@ -1,16 +1,38 @@
 #pragma once
+#include <vector>
 #include "BitStream.h"
 #include "NetworkMessages.h"
+#include "MessageSchema.h"
+
+using namespace std;
 
 class Server;
 class Client;
+class Player;
+class Projectile;
+
+namespace GLib {
+	class World;
+}
 
+//! Creates what a skill cast spawns, returns nullptr for skills without a projectile.
+typedef Projectile* (*SkillSpawner)(GLib::World* pWorld, Player* pPlayer, const XMFLOAT3& start, const XMFLOAT3& end, const XMFLOAT3& dir);
+
+//! Casts are validated and queued when they arrive and spawned together at the
+//! start of the next tick, in the order they arrived. Each skill id has a
+//! spawner in a table, skills without one are rejected when queued.
 class ServerSkillInterpreter
 {
 public:
 	ServerSkillInterpreter();
 	~ServerSkillInterpreter();
 
-	void Interpret(Server* pServer, MessageId id, RakNet::BitStream& bitstream);
+	bool QueueCast(const SkillCastRequest& request);
+	void SpawnQueued(Server* pServer);
 private:
+	void SendCasts(Server* pServer, const SkillCastBatchMessage& message);
+
+	SkillSpawner				mSpawners[256];	// Indexed by skill id.
+	vector<SkillCastRequest>	mQueuedCasts;
+	SkillCastBatchMessage		mBatch;
 };
\ No newline at end of file
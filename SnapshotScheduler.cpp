@@ -0,0 +1,138 @@
+#include "SnapshotScheduler.h"
+#include "Server.h"
+#include "TuningCvars.h"
+#include "RakNetStatistics.h"
+#include "Console.h"
+#include <algorithm>
+
+// Seconds between reading the link statistics.
+static const float	ADAPT_INTERVAL = 0.5f;
+
+// Rate added each interval while the link is fine.
+static const float	RATE_INCREASE = 5.0f;
+
+// Loss in the last second that counts as congestion.
+static const float	MAX_PACKET_LOSS = 0.05f;
+
+// Clients below this part of the max rate only get the players.
+static const float	FULL_DETAIL_RATE = 0.5f;
+
+SnapshotScheduler::SnapshotScheduler(Server* pServer)
+{
+	mServer = pServer;
+	mAdaptDelta = 0.0f;
+	mMaxRate = 0.0f;
+}
+
+SnapshotScheduler::~SnapshotScheduler()
+{
+
+}
+
+void SnapshotScheduler::AddClient(RakNet::SystemAddress adress)
+{
+	ClientLink link;
+	link.adress = adress;
+	link.rate = mServer->GetCvarValue(TuningCvars::SNAPSHOT_MAX_RATE, 60.0f);
+	link.delta = 0.0f;
+	link.backlogTime = 0.0f;
+	link.due = false;
+	mClients.push_back(link);
+}
+
+void SnapshotScheduler::RemoveClient(RakNet::SystemAddress adress)
+{
+	for(int i = 0; i < mClients.size(); i++) {
+		if(mClients[i].adress == adress) {
+			mClients.erase(mClients.begin() + i);
+			break;
+		}
+	}
+}
+
+//! Called every broadcast, maxRate is the broadcast rate of the current phase.
+void SnapshotScheduler::Update(float dt, float maxRate)
+{
+	float minRate = mServer->GetCvarValue(TuningCvars::SNAPSHOT_MIN_RATE, 10.0f);
+	maxRate = min(maxRate, mServer->GetCvarValue(TuningCvars::SNAPSHOT_MAX_RATE, 60.0f));
+	minRate = min(minRate, maxRate);
+	mMaxRate = maxRate;
+
+	mAdaptDelta += dt;
+	bool adapt = mAdaptDelta >= ADAPT_INTERVAL;
+
+	for(int i = 0; i < mClients.size(); i++)
+	{
+		ClientLink& link = mClients[i];
+		if(adapt)
+			Adapt(link, minRate, maxRate);
+
+		link.rate = max(min(link.rate, maxRate), minRate);
+		link.delta += dt;
+		link.due = link.delta >= 1.0f / link.rate - 0.001f;
+		if(link.due)
+			link.delta = 0.0f;
+	}
+
+	if(adapt)
+		mAdaptDelta = 0.0f;
+
+	// Kicking removes the client, so it's done after the loop.
+	for(int i = 0; i < mKicked.size(); i++)
+		mServer->KickClient(mKicked[i], "Connection too slow.");
+
+	mKicked.clear();
+}
+
+//! Halves the rate on loss, congestion or a backlog, otherwise raises it slowly.
+void SnapshotScheduler::Adapt(ClientLink& link, float minRate, float maxRate)
+{
+	RakNet::RakNetStatistics stats;
+	if(mServer->GetRaknetPeer()->GetStatistics(link.adress, &stats) == nullptr)
+		return;
+
+	unsigned int backlog = stats.messagesInResendBuffer;
+	for(int i = 0; i < NUMBER_OF_PRIORITIES; i++)
+		backlog += stats.messageInSendBuffer[i];
+
+	bool backlogged = backlog > mServer->GetCvarValue(TuningCvars::MAX_SEND_BACKLOG, 64.0f);
+	bool congested = backlogged || stats.isLimitedByCongestionControl || stats.packetlossLastSecond > MAX_PACKET_LOSS;
+
+	if(congested)
+		link.rate = max(link.rate * 0.5f, minRate);
+	else
+		link.rate = min(link.rate + RATE_INCREASE, maxRate);
+
+	// Kick clients that can't keep up even at the lowest rate.
+	float kickTime = mServer->GetCvarValue(TuningCvars::BACKLOG_KICK_TIME, 10.0f);
+	link.backlogTime = backlogged ? link.backlogTime + ADAPT_INTERVAL : 0.0f;
+	if(kickTime > 0.0f && link.backlogTime >= kickTime)
+		mKicked.push_back(link.adress);
+}
+
+int SnapshotScheduler::GetNumClients()
+{
+	return mClients.size();
+}
+
+RakNet::SystemAddress SnapshotScheduler::GetAdress(int index)
+{
+	return mClients[index].adress;
+}
+
+bool SnapshotScheduler::IsDue(int index)
+{
+	return mClients[index].due;
+}
+
+//! Clients at a low rate only get the players, the projectiles are predicted from their cast.
+//! Compared against the max rate of the current phase, in the slow phases every client is at it.
+bool SnapshotScheduler::IsFullDetail(int index)
+{
+	return mClients[index].rate >= mMaxRate * FULL_DETAIL_RATE;
+}
+
+float SnapshotScheduler::GetRate(int index)
+{
+	return mClients[index].rate;
+}
\ No newline at end of file
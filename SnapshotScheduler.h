@@ -0,0 +1,46 @@
+#pragma once
+#include <vector>
+#include "RakNetTypes.h"
+
+using namespace std;
+
+class Server;
+
+//! Decides which clients get a snapshot each broadcast. Every client has its
+//! own snapshot rate that is adapted to its link: halved when RakNet reports
+//! loss, congestion or a send backlog, raised a bit at a time otherwise.
+//! Clients at a low rate also get less detail. Clients that stay backlogged
+//! for too long are kicked so they don't hold up everyone on the channel.
+class SnapshotScheduler
+{
+public:
+	SnapshotScheduler(Server* pServer);
+	~SnapshotScheduler();
+
+	void AddClient(RakNet::SystemAddress adress);
+	void RemoveClient(RakNet::SystemAddress adress);
+	void Update(float dt, float maxRate);
+
+	int						GetNumClients();
+	RakNet::SystemAddress	GetAdress(int index);
+	bool					IsDue(int index);
+	bool					IsFullDetail(int index);
+	float					GetRate(int index);
+private:
+	struct ClientLink
+	{
+		RakNet::SystemAddress	adress;
+		float					rate;			// Snapshots per second.
+		float					delta;			// Time since the last snapshot.
+		float					backlogTime;	// Time the link has been backlogged.
+		bool					due;
+	};
+
+	void Adapt(ClientLink& link, float minRate, float maxRate);
+
+	Server*				mServer;
+	vector<ClientLink>	mClients;
+	vector<RakNet::SystemAddress> mKicked;
+	float				mAdaptDelta;
+	float				mMaxRate;		// The effective max rate of the last Update().
+};
\ No newline at end of file
@@ -0,0 +1,188 @@
+#include "SpatialHash.h"
+#include "Object3D.h"
+#include <math.h>
+
+SpatialHash::SpatialHash()
+{
+	mHalfExtent = 0.0f;
+	mCellSize = 1.0f;
+	mCellsPerSide = 0;
+}
+
+SpatialHash::~SpatialHash()
+{
+
+}
+
+//! Sets up a grid of cellsPerSide^2 cells centered at the origin.
+void SpatialHash::Init(float halfExtent, int cellsPerSide)
+{
+	mHalfExtent = halfExtent;
+	mCellsPerSide = cellsPerSide;
+	mCellSize = (halfExtent * 2.0f) / cellsPerSide;
+
+	mCells.clear();
+	mCells.resize(cellsPerSide * cellsPerSide);
+	mOccupiedCells.clear();
+	mEntries.clear();
+}
+
+//! Empties the grid, keeps the allocated memory for the next tick.
+void SpatialHash::Clear()
+{
+	for(int i = 0; i < mOccupiedCells.size(); i++)
+		mCells[mOccupiedCells[i]].clear();
+
+	mOccupiedCells.clear();
+	mEntries.clear();
+}
+
+//! The box is at the end of the tick and start is where its center was at the start.
+//! The owner is the id of the player the object belongs to.
+void SpatialHash::Insert(GLib::Object3D* pObject, const XNA::AxisAlignedBox& box, const XMFLOAT3& start, CollisionLayer layer, int owner)
+{
+	Entry entry;
+	entry.object = pObject;
+	entry.layer = layer;
+	entry.mask = COLLISION_MASKS[layer];
+	entry.owner = owner;
+
+	entry.sphere.start = start;
+	entry.sphere.end = box.Center;
+	entry.sphere.radius = box.Extents.x > box.Extents.z ? box.Extents.x : box.Extents.z;
+	entry.sphere.minY = box.Center.y - box.Extents.y;
+	entry.sphere.maxY = box.Center.y + box.Extents.y;
+
+	// Bounds of the whole sweep.
+	float radius = entry.sphere.radius;
+	entry.minX = (start.x < box.Center.x ? start.x : box.Center.x) - radius;
+	entry.maxX = (start.x > box.Center.x ? start.x : box.Center.x) + radius;
+	entry.minZ = (start.z < box.Center.z ? start.z : box.Center.z) - radius;
+	entry.maxZ = (start.z > box.Center.z ? start.z : box.Center.z) + radius;
+
+	int index = mEntries.size();
+	mEntries.push_back(entry);
+
+	// Objects outside the grid (in the lava) end up in the border cells.
+	int x0 = CellCoord(entry.minX), x1 = CellCoord(entry.maxX);
+	int z0 = CellCoord(entry.minZ), z1 = CellCoord(entry.maxZ);
+
+	for(int z = z0; z <= z1; z++)
+	{
+		for(int x = x0; x <= x1; x++)
+		{
+			int cell = z * mCellsPerSide + x;
+			if(mCells[cell].empty())
+				mOccupiedCells.push_back(cell);
+
+			mCells[cell].push_back(index);
+		}
+	}
+}
+
+//! Adds all pairs with matching layers whose swept boxes overlap in the XZ plane to pairs.
+void SpatialHash::FindCandidatePairs(vector<CollisionPair>& pairs)
+{
+	FindCandidatePairs(0, mOccupiedCells.size(), pairs);
+}
+
+//! Only looks at the occupied cells in [firstCell, lastCell). Doesn't modify the grid,
+//! so different ranges can be processed on different threads.
+void SpatialHash::FindCandidatePairs(int firstCell, int lastCell, vector<CollisionPair>& pairs)
+{
+	for(int c = firstCell; c < lastCell; c++)
+	{
+		int cell = mOccupiedCells[c];
+		vector<int>& indices = mCells[cell];
+
+		for(int i = 0; i < indices.size(); i++)
+		{
+			Entry& a = mEntries[indices[i]];
+			for(int j = i + 1; j < indices.size(); j++)
+			{
+				Entry& b = mEntries[indices[j]];
+
+				// Layer mask and owner rejection, a projectile never hits its owner.
+				if(!(a.mask & COLLISION_BIT(b.layer)) || a.owner == b.owner)
+					continue;
+
+				if(a.maxX < b.minX || b.maxX < a.minX || a.maxZ < b.minZ || b.maxZ < a.minZ)
+					continue;
+
+				// Only report the pair from the cell containing the min corner of the overlap.
+				float overlapX = a.minX > b.minX ? a.minX : b.minX;
+				float overlapZ = a.minZ > b.minZ ? a.minZ : b.minZ;
+				if(CellCoord(overlapZ) * mCellsPerSide + CellCoord(overlapX) != cell)
+					continue;
+
+				Entry& first = a.layer <= b.layer ? a : b;
+				Entry& second = a.layer <= b.layer ? b : a;
+
+				CollisionPair pair;
+				pair.objectA = first.object;
+				pair.objectB = second.object;
+				pair.sphereA = &first.sphere;
+				pair.sphereB = &second.sphere;
+				pair.layerA = first.layer;
+				pair.layerB = second.layer;
+				pair.timeOfImpact = 0.0f;
+				pairs.push_back(pair);
+			}
+		}
+	}
+}
+
+int SpatialHash::GetNumOccupiedCells()
+{
+	return mOccupiedCells.size();
+}
+
+int SpatialHash::CellCoord(float value)
+{
+	int coord = (int)((value + mHalfExtent) / mCellSize);
+
+	if(coord < 0)
+		return 0;
+	else if(coord >= mCellsPerSide)
+		return mCellsPerSide - 1;
+
+	return coord;
+}
+
+//! Swept sphere test in the XZ plane. Returns true if the spheres touch during
+//! the tick, timeOfImpact is the first contact in [0, 1].
+bool IntersectSweptSpheres(const SweptSphere& a, const SweptSphere& b, float& timeOfImpact)
+{
+	if(a.maxY < b.minY || b.maxY < a.minY)
+		return false;
+
+	// Movement of b relative to a.
+	float sx = b.start.x - a.start.x;
+	float sz = b.start.z - a.start.z;
+	float dx = (b.end.x - b.start.x) - (a.end.x - a.start.x);
+	float dz = (b.end.z - b.start.z) - (a.end.z - a.start.z);
+	float r = a.radius + b.radius;
+
+	float c = sx * sx + sz * sz - r * r;
+	if(c <= 0.0f) {
+		timeOfImpact = 0.0f;
+		return true;
+	}
+
+	// Solve |s + t*d|^2 = r^2 for the first t.
+	float qa = dx * dx + dz * dz;
+	float qb = sx * dx + sz * dz;
+	if(qa <= 0.0f || qb >= 0.0f)
+		return false;
+
+	float discriminant = qb * qb - qa * c;
+	if(discriminant < 0.0f)
+		return false;
+
+	float t = (-qb - sqrt(discriminant)) / qa;
+	if(t > 1.0f)
+		return false;
+
+	timeOfImpact = t;
+	return true;
+}
\ No newline at end of file
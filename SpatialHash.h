@@ -0,0 +1,71 @@
+#pragma once
+#include <vector>
+#include "xnacollision.h"
+#include "CollisionLayers.h"
+
+using namespace std;
+
+namespace GLib {
+	class Object3D;
+}
+
+//! Sphere moving from start to end during one collision tick.
+//! The sphere is tested in the XZ plane, minY and maxY is the height span at the end.
+struct SweptSphere
+{
+	XMFLOAT3	start;
+	XMFLOAT3	end;
+	float		radius;
+	float		minY, maxY;
+};
+
+//! Candidate pair found by the broad-phase, ordered so that layerA <= layerB.
+struct CollisionPair
+{
+	GLib::Object3D*		objectA;
+	GLib::Object3D*		objectB;
+	const SweptSphere*	sphereA;
+	const SweptSphere*	sphereB;
+	CollisionLayer		layerA;
+	CollisionLayer		layerB;
+	float				timeOfImpact;
+};
+
+bool IntersectSweptSpheres(const SweptSphere& a, const SweptSphere& b, float& timeOfImpact);
+
+//! Uniform grid covering the arena, used as the collision broad-phase.
+//! Objects are inserted into every cell their swept box overlaps and each
+//! pair is only reported from one cell, so no pair is reported twice.
+//! Pairs whose layers don't collide or that share owner are never reported.
+class SpatialHash
+{
+public:
+	SpatialHash();
+	~SpatialHash();
+
+	void Init(float halfExtent, int cellsPerSide);
+	void Clear();
+	void Insert(GLib::Object3D* pObject, const XNA::AxisAlignedBox& box, const XMFLOAT3& start, CollisionLayer layer, int owner);
+	void FindCandidatePairs(vector<CollisionPair>& pairs);
+	void FindCandidatePairs(int firstCell, int lastCell, vector<CollisionPair>& pairs);
+	int	 GetNumOccupiedCells();
+private:
+	struct Entry
+	{
+		GLib::Object3D*		object;
+		SweptSphere			sphere;
+		CollisionLayer		layer;
+		int					mask;
+		int					owner;
+		float				minX, minZ, maxX, maxZ;
+	};
+
+	int	CellCoord(float value);
+
+	vector<Entry>		mEntries;
+	vector<vector<int>>	mCells;
+	vector<int>			mOccupiedCells;
+	float				mHalfExtent;
+	float				mCellSize;
+	int					mCellsPerSide;
+};
\ No newline at end of file
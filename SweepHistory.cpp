@@ -0,0 +1,99 @@
+#include "SweepHistory.h"
+
+//! The capacity is rounded up to a power of two and at most half of it is used.
+SweepHistory::SweepHistory(int capacity)
+{
+	int size = 1;
+	while(size < capacity * 2)
+		size *= 2;
+
+	Slot empty;
+	empty.id = -1;
+	empty.swept = false;
+	empty.center = XMFLOAT3(0, 0, 0);
+
+	mLast.assign(size, empty);
+	mCurrent.assign(size, empty);
+	mMask = size - 1;
+	mMaxUsed = size / 2;
+	mNumUsed = 0;
+}
+
+SweepHistory::~SweepHistory()
+{
+
+}
+
+//! This tick becomes the last tick, call before the first SetCenter() of a tick.
+void SweepHistory::NextTick()
+{
+	mLast.swap(mCurrent);
+
+	for(int i = 0; i < mCurrent.size(); i++)
+		mCurrent[i].id = -1;
+
+	mNumUsed = 0;
+}
+
+//! Objects have no sweep on the next tick, like after they were moved to their spawn.
+void SweepHistory::Clear()
+{
+	NextTick();
+	NextTick();
+}
+
+//! False for objects that weren't there last tick or jumped since.
+bool SweepHistory::GetLastCenter(int id, XMFLOAT3& center)
+{
+	int slot = FindSlot(mLast, id);
+	if(slot == -1 || mLast[slot].id != id || !mLast[slot].swept)
+		return false;
+
+	center = mLast[slot].center;
+	return true;
+}
+
+//! Objects over the capacity are left out and aren't swept on the next tick.
+void SweepHistory::SetCenter(int id, const XMFLOAT3& center)
+{
+	int slot = FindSlot(mCurrent, id);
+	if(slot == -1)
+		return;
+
+	if(mCurrent[slot].id != id) {
+		if(mNumUsed == mMaxUsed)
+			return;
+
+		mNumUsed++;
+	}
+
+	mCurrent[slot].id = id;
+	mCurrent[slot].swept = true;
+	mCurrent[slot].center = center;
+}
+
+//! The object was teleported or its id reused, it isn't swept on the next tick.
+void SweepHistory::Forget(int id)
+{
+	int slot = FindSlot(mLast, id);
+	if(slot != -1 && mLast[slot].id == id)
+		mLast[slot].swept = false;
+
+	slot = FindSlot(mCurrent, id);
+	if(slot != -1 && mCurrent[slot].id == id)
+		mCurrent[slot].swept = false;
+}
+
+//! The slot with the id, or the empty slot where it goes. Ids are mostly
+//! consecutive, so they spread over the table without hashing.
+int SweepHistory::FindSlot(vector<Slot>& table, int id)
+{
+	for(int i = 0; i <= mMask; i++)
+	{
+		int slot = (id + i) & mMask;
+		if(table[slot].id == id || table[slot].id == -1)
+			return slot;
+	}
+
+	return -1;
+}
\ No newline at end of file
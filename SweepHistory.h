@@ -0,0 +1,38 @@
+#pragma once
+#include <vector>
+#include "xnacollision.h"
+
+using namespace std;
+
+//! Where the collidable objects were at the last collision tick, so the
+//! collision pass can sweep them from there. Two open-addressed tables keyed
+//! by object id with a fixed capacity: the one written this tick and the one
+//! from the last tick. Swapping them each tick drops removed objects by
+//! itself, so nothing is allocated or erased while playing.
+class SweepHistory
+{
+public:
+	SweepHistory(int capacity);
+	~SweepHistory();
+
+	void NextTick();
+	void Clear();
+	bool GetLastCenter(int id, XMFLOAT3& center);
+	void SetCenter(int id, const XMFLOAT3& center);
+	void Forget(int id);
+private:
+	struct Slot
+	{
+		int			id;		// -1 if empty.
+		bool		swept;	// False after Forget(), the object jumped.
+		XMFLOAT3	center;
+	};
+
+	int	 FindSlot(vector<Slot>& table, int id);
+
+	vector<Slot>	mLast;
+	vector<Slot>	mCurrent;
+	int				mMask;
+	int				mMaxUsed;
+	int				mNumUsed;
+};
\ No newline at end of file
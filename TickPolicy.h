@@ -0,0 +1,31 @@
+#pragma once
+
+//! What the server is doing, decides how often it simulates and broadcasts.
+enum SimulationPhase
+{
+	PHASE_LOBBY = 0,
+	PHASE_SHOPPING,
+	PHASE_PLAYING,
+	PHASE_ROUND_ENDED,
+	PHASE_GAME_OVER,
+	NUM_SIMULATION_PHASES
+};
+
+struct TickRates
+{
+	float simulationHz;
+	float broadcastHz;
+};
+
+//! Simulation and world broadcast rates for each phase.
+static const TickRates TICK_POLICY[NUM_SIMULATION_PHASES] =
+{
+	{10.0f, 0.0f},	// Lobby, no world to broadcast.
+	{20.0f, 10.0f},	// Shopping.
+	{60.0f, 60.0f},	// Playing.
+	{20.0f, 10.0f},	// Round ended.
+	{5.0f, 1.0f}	// Game over.
+};
+
+// Never run more simulation steps than this in one frame.
+static const int MAX_SIMULATION_STEPS = 5;
\ No newline at end of file
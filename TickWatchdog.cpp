@@ -0,0 +1,132 @@
+#include "TickWatchdog.h"
+#include "Metrics.h"
+#include "Console.h"
+#include <stdio.h>
+#include <algorithm>
+
+// Seconds of frames looked at together.
+static const float	WINDOW_TIME = 1.0f;
+
+// Overloaded windows in a row before the next step and calm windows in a row before undoing one.
+static const int	OVERLOADED_WINDOWS = 2;
+static const int	CALM_WINDOWS = 5;
+
+// A window is calm when it used less than this part of its budget.
+static const double	CALM_LOAD = 0.6;
+
+static const char*	DEGRADATION_NAMES[NUM_DEGRADATIONS] = {"snapshot_rate", "verbose_logging", "chat_relay", "target_updates"};
+
+static const string	LEVEL_GAUGE = "warlock_degradation_level";
+
+TickWatchdog::TickWatchdog(Metrics* pMetrics)
+{
+	mMetrics = pMetrics;
+	mMaxLevel = NUM_DEGRADATIONS;
+
+	// Built once so counting a step doesn't allocate.
+	for(int i = 0; i < NUM_DEGRADATIONS; i++) {
+		mStepCounters[i][0] = string("warlock_degradation_steps_total{step=\"") + DEGRADATION_NAMES[i] + "\",direction=\"restore\"}";
+		mStepCounters[i][1] = string("warlock_degradation_steps_total{step=\"") + DEGRADATION_NAMES[i] + "\",direction=\"degrade\"}";
+	}
+
+	mLevel = 0;
+	for(int i = 0; i < NUM_DEGRADATIONS; i++)
+		mActive[i] = false;
+
+	Reset();
+	mMetrics->SetGauge(LEVEL_GAUGE, 0);
+}
+
+TickWatchdog::~TickWatchdog()
+{
+
+}
+
+//! Called after every frame with the time the frame's work took and the time it was allowed.
+void TickWatchdog::OnFrame(float dt, double milliseconds, double budget, bool droppedSteps)
+{
+	mWindowTime += dt;
+	mWindowWork += milliseconds;
+	mWindowBudget += budget;
+	mWindowDropped = mWindowDropped || droppedSteps;
+
+	if(mWindowTime < WINDOW_TIME)
+		return;
+
+	double load = mWindowBudget > 0.0 ? mWindowWork / mWindowBudget : 0.0;
+	if(load > 1.0 || mWindowDropped) {
+		mOverloadedWindows++;
+		mCalmWindows = 0;
+	}
+	else if(load < CALM_LOAD) {
+		mCalmWindows++;
+		mOverloadedWindows = 0;
+	}
+	else {
+		mOverloadedWindows = 0;
+		mCalmWindows = 0;
+	}
+
+	if(mOverloadedWindows >= OVERLOADED_WINDOWS && mLevel < mMaxLevel) {
+		SetLevel(mLevel + 1);
+		mOverloadedWindows = 0;
+	}
+	else if(mCalmWindows >= CALM_WINDOWS && mLevel > 0) {
+		SetLevel(mLevel - 1);
+		mCalmWindows = 0;
+	}
+
+	mWindowTime = 0.0f;
+	mWindowWork = 0.0;
+	mWindowBudget = 0.0;
+	mWindowDropped = false;
+}
+
+//! How many steps may be applied, 0 turns the watchdog off.
+void TickWatchdog::SetMaxLevel(int level)
+{
+	mMaxLevel = max(min(level, (int)NUM_DEGRADATIONS), 0);
+	if(mLevel > mMaxLevel)
+		SetLevel(mMaxLevel);
+}
+
+//! Starts over with a new window, call when the tick rate changes.
+void TickWatchdog::Reset()
+{
+	mWindowTime = 0.0f;
+	mWindowWork = 0.0;
+	mWindowBudget = 0.0;
+	mWindowDropped = false;
+	mOverloadedWindows = 0;
+	mCalmWindows = 0;
+}
+
+bool TickWatchdog::IsDegraded(Degradation degradation)
+{
+	return mActive[degradation];
+}
+
+int TickWatchdog::GetLevel()
+{
+	return mLevel;
+}
+
+//! Applies or undoes one step at a time so every step is logged and counted.
+void TickWatchdog::SetLevel(int level)
+{
+	while(mLevel != level)
+	{
+		bool degrade = level > mLevel;
+		Degradation step = degrade ? DEGRADATION_STEPS[mLevel] : DEGRADATION_STEPS[mLevel - 1];
+
+		mActive[step] = degrade;
+		mLevel += degrade ? 1 : -1;
+		mMetrics->AddCount(mStepCounters[step][degrade ? 1 : 0]);
+
+		char buffer[128];
+		sprintf(buffer, "[WATCHDOG] %s %s (level %i)", degrade ? "Degrading" : "Restoring", DEGRADATION_NAMES[step], mLevel);
+		gConsole->AddLine(buffer);
+	}
+
+	mMetrics->SetGauge(LEVEL_GAUGE, mLevel);
+}
\ No newline at end of file
@@ -0,0 +1,57 @@
+#pragma once
+#include <string>
+
+using namespace std;
+
+class Metrics;
+
+//! What the server gives up when it can't keep up with its tick rate.
+enum Degradation
+{
+	DEGRADE_SNAPSHOT_RATE = 0,	// Halve the snapshot rate of all clients.
+	DEGRADE_VERBOSE_LOGGING,	// Stop logging every input and collision.
+	DEGRADE_CHAT_RELAY,			// Relay chat once a second instead of right away.
+	DEGRADE_TARGET_UPDATES,		// Collect the targets of two ticks in each movement update.
+	NUM_DEGRADATIONS
+};
+
+//! The order the degradations are applied in under sustained overload, restored in reverse.
+static const Degradation DEGRADATION_STEPS[NUM_DEGRADATIONS] =
+{
+	DEGRADE_SNAPSHOT_RATE,
+	DEGRADE_VERBOSE_LOGGING,
+	DEGRADE_CHAT_RELAY,
+	DEGRADE_TARGET_UPDATES
+};
+
+//! Compares the time each frame takes to its tick budget. Every second of
+//! frames is one window; after a few overloaded windows in a row the next
+//! degradation step is applied, after more calm windows in a row the last
+//! step is undone. Every step is counted in the metrics.
+class TickWatchdog
+{
+public:
+	TickWatchdog(Metrics* pMetrics);
+	~TickWatchdog();
+
+	void OnFrame(float dt, double milliseconds, double budget, bool droppedSteps);
+	void SetMaxLevel(int level);
+	void Reset();
+
+	bool IsDegraded(Degradation degradation);
+	int	 GetLevel();
+private:
+	void SetLevel(int level);
+
+	Metrics*	mMetrics;
+	string		mStepCounters[NUM_DEGRADATIONS][2];	// Metric names, restore and degrade.
+	bool		mActive[NUM_DEGRADATIONS];
+	int			mLevel;
+	int			mMaxLevel;
+	float		mWindowTime;
+	double		mWindowWork;		// Milliseconds spent in the window.
+	double		mWindowBudget;		// Milliseconds the window was allowed.
+	bool		mWindowDropped;
+	int			mOverloadedWindows;
+	int			mCalmWindows;
+};
\ No newline at end of file
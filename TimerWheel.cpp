@@ -0,0 +1,231 @@
+#include "TimerWheel.h"
+#include <algorithm>
+
+// The first level has one slot per tick, each level above covers 64 slots of the level below.
+static const int	ROOT_BITS = 8;
+static const int	LEVEL_BITS = 6;
+static const int	ROOT_SLOTS = 1 << ROOT_BITS;
+static const int	LEVEL_SLOTS = 1 << LEVEL_BITS;
+static const int	NUM_LEVELS = 4;
+static const unsigned int MAX_DELAY = (1 << (ROOT_BITS + (NUM_LEVELS - 1) * LEVEL_BITS)) - 1;
+
+TimerWheel::TimerWheel(float resolution)
+{
+	mResolution = resolution;
+	mAccumulator = 0.0f;
+	mCurrentTick = 0;
+	mFreeList = -1;
+	mSlots.resize(ROOT_SLOTS + (NUM_LEVELS - 1) * LEVEL_SLOTS, -1);
+}
+
+TimerWheel::~TimerWheel()
+{
+
+}
+
+//! Calls callback once after delay seconds.
+TimerHandle TimerWheel::Schedule(float delay, TimerCallback callback)
+{
+	return Add(ToTicks(delay), 0, callback);
+}
+
+//! Calls callback every interval seconds until canceled.
+TimerHandle TimerWheel::ScheduleRepeating(float interval, TimerCallback callback)
+{
+	unsigned int ticks = ToTicks(interval);
+	if(ticks == 0)
+		ticks = 1;
+
+	return Add(ticks, ticks, callback);
+}
+
+void TimerWheel::Cancel(TimerHandle& handle)
+{
+	if(IsActive(handle)) {
+		Unlink(handle.index);
+		Release(handle.index);
+	}
+
+	handle.index = -1;
+}
+
+bool TimerWheel::IsActive(TimerHandle handle)
+{
+	return handle.index >= 0 && handle.index < mTimers.size() && mTimers[handle.index].generation == handle.generation && mTimers[handle.index].slot != -1;
+}
+
+//! Advances the clock and fires all timers that expired, in order.
+void TimerWheel::Advance(float dt)
+{
+	mAccumulator += dt;
+	while(mAccumulator >= mResolution) {
+		mAccumulator -= mResolution;
+		Tick();
+	}
+}
+
+//! Seconds since the wheel was created.
+float TimerWheel::GetTime()
+{
+	return mCurrentTick * mResolution + mAccumulator;
+}
+
+float TimerWheel::GetTimeLeft(TimerHandle handle)
+{
+	if(!IsActive(handle))
+		return 0.0f;
+
+	return (mTimers[handle.index].expires - mCurrentTick) * mResolution - mAccumulator;
+}
+
+//! Seconds until the next timer fires, at most maxTime. Only looks at the first level.
+float TimerWheel::GetTimeUntilNext(float maxTime)
+{
+	for(int i = 0; i < ROOT_SLOTS && i * mResolution < maxTime; i++) {
+		if(mSlots[(mCurrentTick + i) & (ROOT_SLOTS - 1)] != -1)
+			return max(i * mResolution - mAccumulator, 0.0f);
+	}
+
+	return maxTime;
+}
+
+TimerHandle TimerWheel::Add(unsigned int delay, unsigned int interval, TimerCallback callback)
+{
+	// Reuse a released timer if possible.
+	int index = mFreeList;
+	if(index != -1)
+		mFreeList = mTimers[index].next;
+	else {
+		index = mTimers.size();
+		mTimers.push_back(Timer());
+		mTimers[index].generation = 0;
+	}
+
+	Timer& timer = mTimers[index];
+	timer.callback = callback;
+	timer.expires = mCurrentTick + min(delay, MAX_DELAY);
+	timer.interval = interval;
+	Insert(index);
+
+	TimerHandle handle;
+	handle.index = index;
+	handle.generation = timer.generation;
+	return handle;
+}
+
+unsigned int TimerWheel::ToTicks(float time)
+{
+	if(time <= 0.0f)
+		return 0;
+
+	return (unsigned int)(time / mResolution + 0.5f);
+}
+
+//! Puts the timer in the slot matching how far away it expires.
+void TimerWheel::Insert(int index)
+{
+	Timer& timer = mTimers[index];
+	unsigned int delta = timer.expires - mCurrentTick;
+
+	if(delta > MAX_DELAY) {
+		timer.expires = mCurrentTick + MAX_DELAY;
+		delta = MAX_DELAY;
+	}
+
+	int slot;
+	if(delta < ROOT_SLOTS)
+		slot = timer.expires & (ROOT_SLOTS - 1);
+	else
+	{
+		int level = 1;
+		while(delta >= (1u << (ROOT_BITS + level * LEVEL_BITS)))
+			level++;
+
+		int shift = ROOT_BITS + (level - 1) * LEVEL_BITS;
+		slot = ROOT_SLOTS + (level - 1) * LEVEL_SLOTS + ((timer.expires >> shift) & (LEVEL_SLOTS - 1));
+	}
+
+	timer.slot = slot;
+	timer.prev = -1;
+	timer.next = mSlots[slot];
+	if(timer.next != -1)
+		mTimers[timer.next].prev = index;
+	mSlots[slot] = index;
+}
+
+void TimerWheel::Unlink(int index)
+{
+	Timer& timer = mTimers[index];
+
+	if(timer.prev != -1)
+		mTimers[timer.prev].next = timer.next;
+	else
+		mSlots[timer.slot] = timer.next;
+
+	if(timer.next != -1)
+		mTimers[timer.next].prev = timer.prev;
+
+	timer.slot = -1;
+}
+
+void TimerWheel::Release(int index)
+{
+	Timer& timer = mTimers[index];
+	timer.callback = nullptr;
+	timer.generation++;
+	timer.slot = -1;
+	timer.next = mFreeList;
+	mFreeList = index;
+}
+
+//! Moves the timers in a slot of a higher level down to the levels below.
+void TimerWheel::Cascade(int level, int slotIndex)
+{
+	int slot = ROOT_SLOTS + (level - 1) * LEVEL_SLOTS + slotIndex;
+	int index = mSlots[slot];
+	mSlots[slot] = -1;
+
+	while(index != -1) {
+		int next = mTimers[index].next;
+		Insert(index);
+		index = next;
+	}
+}
+
+void TimerWheel::Tick()
+{
+	int rootIndex = mCurrentTick & (ROOT_SLOTS - 1);
+
+	// Refill the first level when it wraps around.
+	if(rootIndex == 0)
+	{
+		for(int level = 1; level < NUM_LEVELS; level++)
+		{
+			int shift = ROOT_BITS + (level - 1) * LEVEL_BITS;
+			int slotIndex = (mCurrentTick >> shift) & (LEVEL_SLOTS - 1);
+			Cascade(level, slotIndex);
+
+			if(slotIndex != 0)
+				break;
+		}
+	}
+
+	// Fire the expired timers. The callbacks are copied since they can add new timers.
+	while(mSlots[rootIndex] != -1)
+	{
+		int index = mSlots[rootIndex];
+		Unlink(index);
+
+		TimerCallback callback = mTimers[index].callback;
+		if(mTimers[index].interval > 0) {
+			mTimers[index].expires += mTimers[index].interval;
+			Insert(index);
+		}
+		else
+			Release(index);
+
+		callback();
+	}
+
+	mCurrentTick++;
+}
\ No newline at end of file
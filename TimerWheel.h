@@ -0,0 +1,63 @@
+#pragma once
+#include <vector>
+#include <functional>
+
+using namespace std;
+
+typedef function<void()> TimerCallback;
+
+//! Identifies a scheduled timer, stays valid (but inactive) after the timer fired or got canceled.
+struct TimerHandle
+{
+	TimerHandle() : index(-1), generation(0) {}
+
+	int index;
+	int generation;
+};
+
+//! Hierarchical timer wheel driven by the server clock.
+//! Scheduling and canceling is O(1) and callbacks are fired from Advance(),
+//! which is called once at the start of every simulation tick. Timers are
+//! stored as absolute ticks so repeating timers don't drift.
+class TimerWheel
+{
+public:
+	TimerWheel(float resolution);
+	~TimerWheel();
+
+	TimerHandle Schedule(float delay, TimerCallback callback);
+	TimerHandle ScheduleRepeating(float interval, TimerCallback callback);
+	void		Cancel(TimerHandle& handle);
+	bool		IsActive(TimerHandle handle);
+	void		Advance(float dt);
+
+	float		GetTime();
+	float		GetTimeLeft(TimerHandle handle);
+	float		GetTimeUntilNext(float maxTime);
+private:
+	struct Timer
+	{
+		TimerCallback	callback;
+		unsigned int	expires;
+		unsigned int	interval;
+		int				generation;
+		int				slot;
+		int				next;
+		int				prev;
+	};
+
+	TimerHandle		Add(unsigned int delay, unsigned int interval, TimerCallback callback);
+	unsigned int	ToTicks(float time);
+	void			Insert(int index);
+	void			Unlink(int index);
+	void			Release(int index);
+	void			Cascade(int level, int slotIndex);
+	void			Tick();
+
+	vector<Timer>	mTimers;
+	vector<int>		mSlots;
+	int				mFreeList;
+	unsigned int	mCurrentTick;
+	float			mResolution;
+	float			mAccumulator;
+};
\ No newline at end of file
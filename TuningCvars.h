@@ -0,0 +1,43 @@
+#pragma once
+#include <string>
+
+using namespace std;
+
+//! Cvars for tuning the server, read with Server::GetCvarValue(cvar, default)
+//! so they work without being in cvars.cfg.
+namespace TuningCvars
+{
+	// Snapshot rate per client in Hz, adapted between these to the link quality.
+	static const string SNAPSHOT_MIN_RATE = "-snapshot_min_rate";
+	static const string SNAPSHOT_MAX_RATE = "-snapshot_max_rate";
+
+	// Messages waiting to be sent or resent before a link counts as backlogged.
+	static const string MAX_SEND_BACKLOG = "-max_send_backlog";
+
+	// Seconds a client can stay backlogged before it's kicked, 0 never kicks.
+	static const string BACKLOG_KICK_TIME = "-backlog_kick_time";
+
+	// Localhost port the metrics are served on, 0 turns it off.
+	static const string METRICS_PORT = "-metrics_port";
+
+	// Seconds between writing the metrics to a file, 0 turns it off.
+	static const string METRICS_FILE_INTERVAL = "-metrics_file_interval";
+
+	// Part of each frame the server may spend working before it counts as overloaded.
+	static const string TICK_BUDGET = "-tick_budget";
+
+	// Degradation steps the watchdog may apply, 0 turns it off.
+	static const string WATCHDOG_MAX_LEVEL = "-watchdog_max_level";
+
+	// Messages per second each client may send and how many at once, the rest is dropped.
+	static const string TARGET_RATE = "-target_rate";
+	static const string TARGET_BURST = "-target_burst";
+	static const string SKILL_CAST_RATE = "-skill_cast_rate";
+	static const string SKILL_CAST_BURST = "-skill_cast_burst";
+	static const string CHAT_RATE = "-chat_rate";
+	static const string CHAT_BURST = "-chat_burst";
+
+	// 1 records the received packets to data/replay.bin, 1 in play_replay plays them back instead.
+	static const string RECORD_REPLAY = "-record_replay";
+	static const string PLAY_REPLAY = "-play_replay";
+}
\ No newline at end of file
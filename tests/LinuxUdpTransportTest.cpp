@@ -0,0 +1,359 @@
+// Loopback test for LinuxUdpTransport, build and run on a Linux host with:
+// g++ -std=c++11 -I.. LinuxUdpTransportTest.cpp ../LinuxUdpTransport.cpp -o LinuxUdpTransportTest && ./LinuxUdpTransportTest
+#ifdef __linux__
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include "LinuxUdpTransport.h"
+
+static const unsigned short SERVER_PORT = 27910;
+static const unsigned short RELAY_PORT = 27911;
+
+static int gFailures = 0;
+
+#define CHECK(condition) \
+	if(!(condition)) { \
+		printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+		gFailures++; \
+	}
+
+static sockaddr_in MakeAdress(unsigned short port)
+{
+	sockaddr_in adress;
+	memset(&adress, 0, sizeof(adress));
+	adress.sin_family = AF_INET;
+	adress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	adress.sin_port = htons(port);
+	return adress;
+}
+
+//! What one endpoint received in a frame, copied since the transport reuses it.
+struct Received
+{
+	vector<TransportEvent>			events;
+	vector<int>						peers;
+	vector< vector<unsigned char> >	messages;
+
+	int Count(TransportEvent event)
+	{
+		int count = 0;
+		for(int i = 0; i < events.size(); i++)
+			count += events[i] == event;
+		return count;
+	}
+};
+
+static void Pump(LinuxUdpTransport& transport, unsigned int time, Received& received)
+{
+	transport.Update(time);
+
+	TransportMessage message;
+	while(transport.Receive(message)) {
+		received.events.push_back(message.event);
+		received.peers.push_back(message.peer);
+		received.messages.push_back(vector<unsigned char>(message.data, message.data + message.length));
+	}
+
+	transport.Flush();
+}
+
+//! Forwards datagrams between one client and the server and drops every dropEvery'th in both directions.
+class LossyRelay
+{
+public:
+	LossyRelay(int dropEvery)
+	{
+		mSocket = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+		sockaddr_in adress = MakeAdress(RELAY_PORT);
+		bind(mSocket, (sockaddr*)&adress, sizeof(adress));
+		mServer = MakeAdress(SERVER_PORT);
+		memset(&mClient, 0, sizeof(mClient));
+		mDropEvery = dropEvery;
+		mCounter = 0;
+		mDropped = 0;
+	}
+
+	~LossyRelay()
+	{
+		close(mSocket);
+	}
+
+	void Pump()
+	{
+		unsigned char data[4096];
+		sockaddr_in from;
+		socklen_t fromLength = sizeof(from);
+
+		int length;
+		while((length = recvfrom(mSocket, data, sizeof(data), 0, (sockaddr*)&from, &fromLength)) > 0)
+		{
+			bool fromServer = from.sin_port == mServer.sin_port;
+			if(!fromServer)
+				mClient = from;
+
+			if(++mCounter % mDropEvery == 0)
+				mDropped++;
+			else
+				sendto(mSocket, data, length, 0, (sockaddr*)(fromServer ? &mClient : &mServer), sizeof(sockaddr_in));
+
+			fromLength = sizeof(from);
+		}
+	}
+
+	int GetDropped()
+	{
+		return mDropped;
+	}
+private:
+	int			mSocket;
+	sockaddr_in	mServer;
+	sockaddr_in	mClient;
+	int			mDropEvery;
+	int			mCounter;
+	int			mDropped;
+};
+
+//! Runs frames of 10 ms on all endpoints, the short sleep lets loopback deliver.
+static unsigned int gTime = 1000;
+
+static void Step(LinuxUdpTransport& server, Received& serverReceived, LinuxUdpTransport* pClient, Received* pClientReceived, LossyRelay* pRelay = NULL)
+{
+	gTime += 10;
+	Pump(server, gTime, serverReceived);
+	if(pRelay != NULL)
+		pRelay->Pump();
+
+	usleep(500);
+	if(pClient != NULL)
+		Pump(*pClient, gTime, *pClientReceived);
+
+	if(pRelay != NULL)
+		pRelay->Pump();
+
+	usleep(500);
+}
+
+static int Connect(LinuxUdpTransport& server, Received& serverReceived, LinuxUdpTransport& client, unsigned short port)
+{
+	Received clientReceived;
+	client.Update(gTime);
+	int peer = client.Connect(MakeAdress(port));
+
+	for(int i = 0; i < 20 && clientReceived.Count(TRANSPORT_CONNECTED) == 0; i++)
+		Step(server, serverReceived, &client, &clientReceived);
+
+	CHECK(clientReceived.Count(TRANSPORT_CONNECTED) == 1);
+	CHECK(client.IsConnected(peer));
+	return peer;
+}
+
+//! Nothing but a valid handshake creates a peer.
+static void TestHandshake(LinuxUdpTransport& server)
+{
+	int raw = socket(AF_INET, SOCK_DGRAM, 0);
+	sockaddr_in serverAdress = MakeAdress(SERVER_PORT);
+
+	// Too short, a reliable datagram without a handshake and a CONNECT with a made up cookie.
+	unsigned char shortDatagram[4] = {1, 0, 0, 0};
+	unsigned char reliable[12] = {CHANNEL_RELIABLE, 0, 0, 0, 0, 0, 0, 0, 0, 'a', 'b', 'c'};
+	unsigned char connect[13] = {CHANNEL_CONNECT, 0, 0, 0, 0, 0, 0, 0, 0, 0x12, 0x34, 0x56, 0x79};
+	sendto(raw, shortDatagram, sizeof(shortDatagram), 0, (sockaddr*)&serverAdress, sizeof(serverAdress));
+	sendto(raw, reliable, sizeof(reliable), 0, (sockaddr*)&serverAdress, sizeof(serverAdress));
+	sendto(raw, connect, sizeof(connect), 0, (sockaddr*)&serverAdress, sizeof(serverAdress));
+	usleep(1000);
+
+	Received serverReceived;
+	Step(server, serverReceived, NULL, NULL);
+	CHECK(serverReceived.events.empty());
+
+	// The bad CONNECT got a CHALLENGE, and echoing its cookie connects.
+	unsigned char challenge[64];
+	int length = recv(raw, challenge, sizeof(challenge), MSG_DONTWAIT);
+	CHECK(length == 13 && challenge[0] == CHANNEL_CHALLENGE);
+	if(length == 13)
+	{
+		memcpy(connect + 9, challenge + 9, 4);
+		sendto(raw, connect, sizeof(connect), 0, (sockaddr*)&serverAdress, sizeof(serverAdress));
+		usleep(1000);
+		Step(server, serverReceived, NULL, NULL);
+		CHECK(serverReceived.Count(TRANSPORT_CONNECTED) == 1);
+
+		length = recv(raw, challenge, sizeof(challenge), MSG_DONTWAIT);
+		CHECK(length == 13 && challenge[0] == CHANNEL_ACCEPT);
+	}
+
+	close(raw);
+
+	// Let the raw peer time out so it doesn't disturb the other tests.
+	for(int i = 0; i < 1100 && serverReceived.Count(TRANSPORT_DISCONNECTED) == 0; i++)
+		Step(server, serverReceived, NULL, NULL);
+
+	CHECK(serverReceived.Count(TRANSPORT_DISCONNECTED) == 1);
+}
+
+//! Reliable messages arrive once and in order through a relay that loses datagrams.
+static void TestOrderingAndResends(LinuxUdpTransport& server)
+{
+	LossyRelay relay(4);
+	LinuxUdpTransport client;
+	CHECK(client.Start(0));
+
+	Received serverReceived, clientReceived;
+	client.Update(gTime);
+	int serverPeer = client.Connect(MakeAdress(RELAY_PORT));
+	for(int i = 0; i < 50 && serverReceived.Count(TRANSPORT_CONNECTED) == 0; i++)
+		Step(server, serverReceived, &client, &clientReceived, &relay);
+
+	CHECK(serverReceived.Count(TRANSPORT_CONNECTED) == 1);
+	if(serverReceived.Count(TRANSPORT_CONNECTED) != 1)
+		return;
+
+	int clientPeer = serverReceived.peers[serverReceived.events.size() - 1];
+	const int NUM_MESSAGES = 1000;
+
+	int nextSend = 0;
+	vector<int> order;
+	for(int i = 0; i < 3000 && order.size() < NUM_MESSAGES; i++)
+	{
+		// Up to 100 a frame, more than fits the window so Send() has to refuse some.
+		for(int j = 0; j < 100 && nextSend < NUM_MESSAGES; j++) {
+			unsigned char data[4];
+			memcpy(data, &nextSend, 4);
+			if(!server.Send(clientPeer, data, 4, CHANNEL_RELIABLE))
+				break;
+			nextSend++;
+		}
+
+		clientReceived = Received();
+		Step(server, serverReceived, &client, &clientReceived, &relay);
+		for(int j = 0; j < clientReceived.events.size(); j++) {
+			if(clientReceived.events[j] == TRANSPORT_MESSAGE && clientReceived.messages[j].size() == 4) {
+				int number;
+				memcpy(&number, &clientReceived.messages[j][0], 4);
+				order.push_back(number);
+			}
+		}
+	}
+
+	// The last acks.
+	for(int i = 0; i < 50; i++)
+		Step(server, serverReceived, &client, &clientReceived, &relay);
+
+	CHECK(order.size() == NUM_MESSAGES);
+	bool inOrder = true;
+	for(int i = 0; i < order.size(); i++)
+		inOrder = inOrder && order[i] == i;
+
+	CHECK(inOrder);
+	CHECK(relay.GetDropped() > 0);
+	CHECK(server.GetBacklog(clientPeer) == 0);
+	CHECK(client.GetBacklog(serverPeer) == 0);
+	server.Disconnect(clientPeer);
+}
+
+//! More than a batch of datagrams in one frame while another peer is owed an ack, and GSO runs over 64 KB.
+static void TestLargeFlush(LinuxUdpTransport& server)
+{
+	LinuxUdpTransport first, second;
+	CHECK(first.Start(0));
+	CHECK(second.Start(0));
+
+	Received serverReceived;
+	Connect(server, serverReceived, first, SERVER_PORT);
+	int secondServer = Connect(server, serverReceived, second, SERVER_PORT);
+	CHECK(serverReceived.Count(TRANSPORT_CONNECTED) == 2);
+	if(serverReceived.Count(TRANSPORT_CONNECTED) != 2)
+		return;
+
+	int firstPeer = serverReceived.peers[serverReceived.events.size() - 2];
+	int secondPeer = serverReceived.peers[serverReceived.events.size() - 1];
+
+	// The second client sends something reliable, so the server owes it an ack.
+	unsigned char hello[1] = {1};
+	second.Send(secondServer, hello, 1, CHANNEL_RELIABLE);
+	second.Flush();
+	usleep(1000);
+	gTime += 10;
+	Pump(server, gTime, serverReceived);
+
+	// 200 small datagrams, then 63 of 1100 bytes that would be 69 KB as one GSO send.
+	unsigned char data[1100];
+	memset(data, 7, sizeof(data));
+	for(int i = 0; i < 200; i++)
+		CHECK(server.Send(firstPeer, data, 40, CHANNEL_UNRELIABLE));
+
+	server.Flush();
+	usleep(2000);
+
+	Received firstReceived;
+	gTime += 10;
+	Pump(first, gTime, firstReceived);
+	CHECK(firstReceived.Count(TRANSPORT_MESSAGE) == 200);
+
+	for(int i = 0; i < 63; i++)
+		server.Send(firstPeer, data, sizeof(data), CHANNEL_UNRELIABLE);
+
+	server.Flush();
+	usleep(2000);
+
+	firstReceived = Received();
+	gTime += 10;
+	Pump(first, gTime, firstReceived);
+	CHECK(firstReceived.Count(TRANSPORT_MESSAGE) == 63);
+
+	// The second client got its ack.
+	Received secondReceived;
+	Pump(second, gTime, secondReceived);
+	CHECK(second.GetBacklog(secondServer) == 0);
+
+	server.Disconnect(firstPeer);
+	server.Disconnect(secondPeer);
+}
+
+//! Quiet peers stay connected through heartbeats, a peer that stops updating times out.
+static void TestHeartbeatAndTimeout(LinuxUdpTransport& server)
+{
+	LinuxUdpTransport client;
+	CHECK(client.Start(0));
+
+	Received serverReceived, clientReceived;
+	Connect(server, serverReceived, client, SERVER_PORT);
+
+	// 30 seconds with nothing to send, like a client in the lobby.
+	serverReceived = Received();
+	for(int i = 0; i < 3000; i++)
+		Step(server, serverReceived, &client, &clientReceived);
+
+	CHECK(serverReceived.Count(TRANSPORT_DISCONNECTED) == 0);
+	CHECK(clientReceived.Count(TRANSPORT_DISCONNECTED) == 0);
+
+	// Now the client stops.
+	for(int i = 0; i < 1100; i++)
+		Step(server, serverReceived, NULL, NULL);
+
+	CHECK(serverReceived.Count(TRANSPORT_DISCONNECTED) == 1);
+}
+
+int main()
+{
+	LinuxUdpTransport server;
+	if(!server.Start(SERVER_PORT)) {
+		printf("Couldn't start the server on port %d\n", SERVER_PORT);
+		return 1;
+	}
+
+	TestHandshake(server);
+	TestOrderingAndResends(server);
+	TestLargeFlush(server);
+	TestHeartbeatAndTimeout(server);
+
+	printf("%s, %d failures\n", gFailures == 0 ? "Passed" : "Failed", gFailures);
+	return gFailures == 0 ? 0 : 1;
+}
+#else
+int main()
+{
+	return 0;
+}
+#endif
\ No newline at end of file
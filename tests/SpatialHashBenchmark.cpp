@@ -0,0 +1,155 @@
+// Collision pass benchmark, the spatial hash against the all-pairs box test
+// that GLib's World::Update runs. Build and run with:
+// g++ -std=c++11 -O2 -Istubs -I.. SpatialHashBenchmark.cpp ../SpatialHash.cpp -o SpatialHashBenchmark && ./SpatialHashBenchmark
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include "Object3D.h"
+#include "SpatialHash.h"
+
+// Same grid as ServerArena, around the default arena.
+static const float	ARENA_RADIUS = 60.0f;
+static const float	COLLISION_GRID_SCALE = 1.5f;
+static const int	COLLISION_GRID_CELLS = 16;
+
+// A quarter of the objects are players, the rest projectiles.
+static const float	PLAYER_EXTENT = 1.5f;
+static const float	PROJECTILE_EXTENT = 0.5f;
+static const float	PROJECTILE_SPEED = 1.0f;	// Per tick.
+
+static const int	NUM_TICKS = 2000;
+
+struct BenchObject
+{
+	GLib::Object3D			object;
+	XNA::AxisAlignedBox		box;
+	XMFLOAT3				start;
+	XMFLOAT3				velocity;
+	CollisionLayer			layer;
+	int						owner;
+};
+
+static float Random(float min, float max)
+{
+	return min + (max - min) * (rand() / (float)RAND_MAX);
+}
+
+static void CreateObjects(vector<BenchObject>& objects, int count)
+{
+	objects.resize(count);
+	for(int i = 0; i < count; i++)
+	{
+		BenchObject& object = objects[i];
+		bool player = i < count / 4 || i == 0;
+		float extent = player ? PLAYER_EXTENT : PROJECTILE_EXTENT;
+		float angle = Random(0.0f, 6.2832f), distance = Random(0.0f, ARENA_RADIUS);
+
+		object.box.Center = XMFLOAT3(cos(angle) * distance, extent, sin(angle) * distance);
+		object.box.Extents = XMFLOAT3(extent, extent, extent);
+		object.start = object.box.Center;
+		object.layer = player ? COLLISION_LAYER_PLAYER : COLLISION_LAYER_PROJECTILE;
+		object.owner = player ? i : rand() % (count / 4 + 1);
+
+		float heading = Random(0.0f, 6.2832f);
+		float speed = player ? 0.0f : PROJECTILE_SPEED;
+		object.velocity = XMFLOAT3(cos(heading) * speed, 0.0f, sin(heading) * speed);
+	}
+}
+
+//! Moves the projectiles and wraps them around the arena.
+static void MoveObjects(vector<BenchObject>& objects)
+{
+	for(int i = 0; i < objects.size(); i++)
+	{
+		BenchObject& object = objects[i];
+		object.start = object.box.Center;
+		object.box.Center.x += object.velocity.x;
+		object.box.Center.z += object.velocity.z;
+
+		if(object.box.Center.x * object.box.Center.x + object.box.Center.z * object.box.Center.z > ARENA_RADIUS * ARENA_RADIUS) {
+			object.box.Center.x = -object.box.Center.x;
+			object.box.Center.z = -object.box.Center.z;
+			object.start = object.box.Center;
+		}
+	}
+}
+
+//! What the World does, a box test on every pair.
+static int AllPairs(vector<BenchObject>& objects)
+{
+	int hits = 0;
+	for(int i = 0; i < objects.size(); i++)
+	{
+		const XNA::AxisAlignedBox& a = objects[i].box;
+		for(int j = i + 1; j < objects.size(); j++)
+		{
+			const XNA::AxisAlignedBox& b = objects[j].box;
+			if(fabs(a.Center.x - b.Center.x) <= a.Extents.x + b.Extents.x &&
+				fabs(a.Center.y - b.Center.y) <= a.Extents.y + b.Extents.y &&
+				fabs(a.Center.z - b.Center.z) <= a.Extents.z + b.Extents.z)
+				hits++;
+		}
+	}
+
+	return hits;
+}
+
+//! What ServerArena::UpdateCollisions() does, on one thread.
+static int SpatialHashPass(SpatialHash& hash, vector<BenchObject>& objects, vector<CollisionPair>& pairs)
+{
+	hash.Clear();
+	for(int i = 0; i < objects.size(); i++)
+		hash.Insert(&objects[i].object, objects[i].box, objects[i].start, objects[i].layer, objects[i].owner);
+
+	pairs.clear();
+	hash.FindCandidatePairs(pairs);
+
+	int hits = 0;
+	for(int i = 0; i < pairs.size(); i++)
+		hits += IntersectSweptSpheres(*pairs[i].sphereA, *pairs[i].sphereB, pairs[i].timeOfImpact);
+
+	return hits;
+}
+
+static double Microseconds(chrono::high_resolution_clock::time_point start)
+{
+	return chrono::duration<double, micro>(chrono::high_resolution_clock::now() - start).count();
+}
+
+static void Run(int count)
+{
+	srand(count);
+	vector<BenchObject> objects;
+	CreateObjects(objects, count);
+
+	SpatialHash hash;
+	hash.Init(ARENA_RADIUS * COLLISION_GRID_SCALE, COLLISION_GRID_CELLS);
+	vector<CollisionPair> pairs;
+
+	double allPairsTime = 0.0, hashTime = 0.0;
+	int allPairsHits = 0, hashHits = 0;
+	for(int tick = 0; tick < NUM_TICKS; tick++)
+	{
+		MoveObjects(objects);
+
+		auto start = chrono::high_resolution_clock::now();
+		allPairsHits += AllPairs(objects);
+		allPairsTime += Microseconds(start);
+
+		start = chrono::high_resolution_clock::now();
+		hashHits += SpatialHashPass(hash, objects, pairs);
+		hashTime += Microseconds(start);
+	}
+
+	printf("%4d objects: all pairs %8.2f us/tick, spatial hash %8.2f us/tick (%d and %d hits)\n",
+		count, allPairsTime / NUM_TICKS, hashTime / NUM_TICKS, allPairsHits, hashHits);
+}
+
+int main()
+{
+	Run(10);
+	Run(64);
+	Run(256);
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,9 @@
+#pragma once
+
+// Stand-in for the GLib object, the standalone tests only pass pointers around.
+namespace GLib
+{
+	class Object3D
+	{
+	};
+}
\ No newline at end of file
@@ -0,0 +1,19 @@
+#pragma once
+
+// The parts of the DirectX math and collision headers the standalone tests use.
+struct XMFLOAT3
+{
+	XMFLOAT3() {}
+	XMFLOAT3(float _x, float _y, float _z) : x(_x), y(_y), z(_z) {}
+
+	float x, y, z;
+};
+
+namespace XNA
+{
+	struct AxisAlignedBox
+	{
+		XMFLOAT3 Center;
+		XMFLOAT3 Extents;
+	};
+}
\ No newline at end of file